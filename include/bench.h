@@ -0,0 +1,10 @@
+#include "search.h"
+
+#pragma once
+
+
+/* Searches a fixed set of positions to a fixed depth, each from an empty transposition table, and prints the total
+nodes, time and nodes per second. With one thread the node count only changes when the search does, which makes it
+a quick check that a change meant to be a speedup didn't change the search, and a measure of how much a change to
+pruning or move ordering shrinks the tree */
+void RunBench(Search &search, int depth);
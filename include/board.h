@@ -1,7 +1,11 @@
 #include <vector>
+#include <array>
 #include <iostream>
+#include <atomic>
 #include "utils.h"
 #include "move_calc.h"
+#include "perft_table.h"
+#include "time_manager.h"
 
 #pragma once
 
@@ -9,6 +13,9 @@
 class Board
 {
 
+    // the move picker orders moves with the board's killer moves and move scores
+    friend class MovePicker;
+
 public:
     
     // Constructor function for board. Takes care of setting everything up.
@@ -29,14 +36,36 @@ public:
     // Generates the best possible move after searching to a given depth
     int GetBestMove(int depth);
 
-    // Chooses a move via the start and end positions and calls the make move function
-    int MakeMove(int move, int move_flag);
+    // Gets the board ready for a new search (killers, history, PV and root moves), before the first SearchRoot
+    void NewSearch();
+
+    // Searches the root position to the given depth within the window (alpha, beta) and returns the score for the
+    // side to move. Called once per iteration (and again when the score falls outside the window)
+    int SearchRoot(int depth, int alpha, int beta);
+
+    // Makes a legal move on the board, pushing what it overwrites onto the undo stack
+    void MakeMove(int move);
+
+    // Takes back the last move made by MakeMove, restoring the board state from the undo stack
+    void UnmakeMove(int move);
+
+    // Generates the legal moves of the given kind (all_moves, only_captures, ...) and adds them to the move list.
+    // Only pieces standing on source_mask are moved
+    void GenerateMoves(MoveList* move_list, int gen_type = all_moves, U64 source_mask = ~0ULL);
 
-    // Generates all possible moves based on the board state and adds them to the move list
-    void GenerateMoves(MoveList* move_list);
+    // Returns the number of legal moves of the side to move, counted with popcounts without generating them
+    int CountLegalMoves();
+
+    // Returns true if the move is legal in the current position (for moves that didn't come from GenerateMoves)
+    bool IsLegalMove(int move);
     
-    /* Driver around the perft function for move generation */
-    void perft_driver(int depth);
+    /* Driver around the perft function for move generation, splitting the work over the given number of threads.
+    With a hash table the counts of transposed subtrees are looked up in it. The caller owns the table, so one table
+    can serve any number of runs: its entries are exact counts for a position and depth, which stay true */
+    void perft_driver(int depth, int threads = 1, PerftTable *table = nullptr);
+
+    // Counts the nodes of the move tree to the given depth without printing anything (threads and hash as above)
+    U64 PerftNodes(int depth, int threads = 1, PerftTable *table = nullptr);
 
     /* Displays the board in a human-readable format with ASCII pieces */
     void Display();
@@ -54,39 +83,50 @@ public:
 
     int best_move;          // Stores the best move within a search
 
-    int nodes;
+    U64 nodes;
     int ply;
 
     // PV length
-    int pv_length[64];
+    int pv_length[max_ply];
 
     // PV table
-    int pv_table[64][64];
+    Move pv_table[max_ply][max_ply];
 
-    
-    
+    // Beta cutoffs in NegaMax since NewSearch, and how many of them the first move searched caused. The closer the
+    // two are the better the moves are ordered
+    U64 beta_cutoffs;
+    U64 first_move_cutoffs;
 
-private:
-    // Helper macro to copy the board state for copy/make approach
-    #define copy_board()                                                                    \
-        U64 pieces_copy[12], occupancies_copy[3];                                           \
-        int turn_copy, enpassant_copy, castle_copy;                                         \
-        memcpy(pieces_copy, pieces, sizeof(pieces));                                        \
-        memcpy(occupancies_copy, occupancies, sizeof(occupancies));                         \
-        turn_copy=turn_to_move, enpassant_copy=enpassant, castle_copy=castling_rights;  
-
-    // Helper macro to restore the board state for copy/make approach
-    #define take_back()                                                                     \
-        memcpy(pieces, pieces_copy, sizeof(pieces));                                        \
-        memcpy(occupancies, occupancies_copy, sizeof(occupancies));                         \
-        turn_to_move=turn_copy, enpassant=enpassant_copy, castling_rights=castle_copy;  
+    // Whether the search uses null move pruning and late move reductions (UCI options, for A/B testing)
+    static bool null_move_pruning;
+    static bool late_move_reductions;
 
-    
+    // Flag that stops the search when set, shared by every thread searching together (nullptr if there is none).
+    // An interrupted search returns a meaningless score and PV
+    std::atomic<bool> *stop_flag = nullptr;
+
+    // Time manager the board checks every 2048 nodes, setting the stop flag once its hard limit is reached. Only the
+    // main search thread's board has one
+    TimeManager *time_manager = nullptr;
+
+    // History of quiet moves following one earlier move, [piece][target square] of the move being scored
+    typedef std::array<std::array<int16_t, 64>, 12> PieceToHistory;
 
+    // Continuation history [piece * 64 + target square of an earlier move], one table for the move one ply before
+    // and two plies before alike (nullptr searches without it). It is over a megabyte, so it isn't part of the board:
+    // the Search owns one per thread for as long as it keeps that thread, and clears it for every search
+    PieceToHistory *continuation_history = nullptr;
+
+    
+    
 
+private:
     // piece bitboards
     U64 pieces[12];
 
+    // Piece standing on every square (no_piece if it is empty), kept in step with the piece bitboards
+    int piece_on[64];
+
     // Occupancy bitboards (white, black, both)
     U64 occupancies[3];
 
@@ -97,27 +137,36 @@ private:
     // This stores castling rights
     int castling_rights;
 
+    // Undo records for the moves currently made on the board, one per ply, and how many are in use
+    UndoInfo undo_stack[max_ply];
+    int undo_count;
+
+    // Zobrist key of the current position, updated incrementally by MakeMove
+    U64 hash_key;
+
+    // Computes the Zobrist key of the current position from scratch
+    U64 GenerateHashKey();
+
+    // Hash table perft looks subtree counts up in (nullptr when perft isn't hashed), how often it was probed and hit,
+    // and the number of leaf nodes perft actually reached rather than took from the table
+    PerftTable *perft_table = nullptr;
+    U64 perft_probes = 0;
+    U64 perft_hits = 0;
+    U64 perft_leaves = 0;
+
     // This board stores the castling rights for any potential moves. If a piece moves to or from a square
     // that isn't 15 (indicating full castling rights), they lose some castling right. For example if the rook at a1 moves,
     // the castling rights are &'ed with 13, meaning that white queenside castle is no longer available.
-    const int board_castling_rights[64] = {
-    13, 15, 15, 15,  12, 15, 15, 14,
-    15, 15, 15, 15, 15, 15, 15, 15,
-    15, 15, 15, 15, 15, 15, 15, 15,
-    15, 15, 15, 15, 15, 15, 15, 15,
-    15, 15, 15, 15, 15, 15, 15, 15,
-    15, 15, 15, 15, 15, 15, 15, 15,
-    15, 15, 15, 15, 15, 15, 15, 15,
-     7, 15, 15, 15,  3, 15, 15, 11 
-};
+    static const int board_castling_rights[64];
 
-    // Calculates and stores all of the pre-initialized attacks
-    MoveCalc move_calc;
+    // The move generator, legal move counter, MakeMove and UnmakeMove for one side. The public versions dispatch to these once per call
+    template <Color side> void GenerateMoves(MoveList* move_list, int gen_type, U64 source_mask);
+    template <Color side> int CountLegalMoves();
+    template <Color side> void MakeMove(int move);
+    template <Color side> void UnmakeMove(int move);
 
-    // Used to generate moves for pawns, and king castling. Adds them to the move list pointer
-    void GenerateQuietPawnMoves(MoveList* move_list);
-    void GenerateCastleMoves(MoveList* move_list);
-    void GeneratePawnAttacks(MoveList* move_list);
+    // Generates the moves of one kind of piece (N, B, R or Q) of one side, used by GenerateMoves
+    template <Color side, int piece> void GeneratePieceMoves(MoveList* move_list, U64 source_mask, U64 target_mask, U64 pinned, int king_square);
 
     // Function that adds a move to a move list struct and updates how many moves exist within it 
     void AddMove(MoveList *move_list, int move);
@@ -125,111 +174,109 @@ private:
     // Returns true if the given square is being attacked by the given color side
     bool IsSquareAttacked(int square, int color);
 
+    // Returns the pieces of the given side pinned to their king (on the given square)
+    template <Color side> U64 PinnedPieces(int king_square);
+
+    // Returns the pieces of the given side attacking a square, with sliders seeing through the given occupancy
+    template <Color side> U64 AttackersOf(int square, U64 occupancy);
+
     // Helper function, inner loop of perft driver that recursively generates moves to a certain depth
-    int perft(int depth);
+    U64 perft(int depth);
+
+    // Counts the nodes under each of the root moves to the given depth, with a pool of threads if there is more than one
+    std::vector<U64> PerftDivide(MoveList &moves, int depth, int threads);
+
+    // Counts the nodes under each of the root moves to the given depth with a pool of threads
+    std::vector<U64> ParallelPerft(MoveList &moves, int depth, int threads);
+
+    // True once the search has been told to stop
+    bool Stopped() { return stop_flag && stop_flag->load(std::memory_order_relaxed); }
+
+    // Counts a searched node, looking at the clock every 2048 of them
+    void CountNode();
+
+    // Legal moves at the root, in the order to search them, and the nodes each took in the last search of the root
+    MoveList root_moves;
+    U64 root_nodes[max_moves];
 
-    // Negamax search function with alpha beta pruning. Returns best move found
-    int NegaMax(int alpha, int beta, int depth);
+    // PV of the last iteration that finished inside its window, and whether the search is still on it
+    Move last_pv[max_ply];
+    int last_pv_length;
+    bool follow_pv;
 
-    // Quiescence search, searches capture moves until reaching a calm position
+    // Whether the move that led to each ply was a null move, two are never made in a row
+    bool null_move[max_ply] = {};
+
+    // Passes the turn for null move pruning, and takes that back
+    void MakeNullMove();
+    void UnmakeNullMove();
+
+    // Reorders the root moves for the next search of the root, best move first (-1 if there is none)
+    void SortRootMoves(int best_index);
+
+    // Principal variation search of the position to the given depth, node_type being the kind of node it is
+    // expected to be (pv_node, cut_node or all_node). Fail-soft: the score can fall outside the window (alpha, beta)
+    int NegaMax(int alpha, int beta, int depth, int node_type);
+
+    // Quiescence search, searches capture moves until reaching a calm position. Fail-soft like NegaMax
     int Quiescence(int alpha, int beta);
 
     // Scores a move to order them for alpha-beta pruning
     int ScoreMove(int move);
 
-    // sorts a move list so that best move is first
+    // Static exchange evaluation: the material the side to move wins with a capture (or promotion) once every
+    // exchange that follows on its target square is played out, negative if it loses material
+    int StaticExchange(int move);
+
+    // sorts a move list so that best move is first, for the root moves (other nodes use the move picker)
     void SortMoves(MoveList *move_list);
 
     /***
      * Tables used for positional piece evaluation 
      ***/
     // pawn positional score
-    const int pawn_scores[64] = 
-    {
-
-        0,   0,   0,   0,   0,   0,   0,   0,
-        0,   0,   0, -10, -10,   0,   0,   0,
-        0,   0,   0,   5,   5,   0,   0,   0,
-        5,   5,  10,  20,  20,   5,   5,   5,
-        10,  10,  10,  20,  20,  10,  10,  10,
-        20,  20,  20,  30,  30,  30,  20,  20,
-        30,  30,  30,  40,  40,  30,  30,  30,
-        90,  90,  90,  90,  90,  90,  90,  90
-    };
+    static const int pawn_scores[64];
 
     // knight positional score
-    const int knight_scores[64] = 
-    {
-        -5, -10,   0,   0,   0,   0, -10,  -5,
-        -5,   0,   0,   0,   0,   0,   0,  -5,
-        -5,   5,  20,  10,  10,  20,   5,  -5,
-        -5,  10,  20,  30,  30,  20,  10,  -5,
-        -5,  10,  20,  30,  30,  20,  10,  -5,
-        -5,   5,  20,  20,  20,  20,   5,  -5,
-        -5,   0,   0,  10,  10,   0,   0,  -5,
-        -5,   0,   0,   0,   0,   0,   0,  -5
-    };
+    static const int knight_scores[64];
 
     // bishop positional score
-    const int bishop_scores[64] = 
-    {
-        0,   0, -10,   0,   0, -10,   0,   0,
-        0,  30,   0,   0,   0,   0,  30,   0,
-        0,  10,   0,   0,   0,   0,  10,   0,
-        0,   0,  10,  20,  20,  10,   0,   0,
-        0,   0,  10,  20,  20,  10,   0,   0,
-        0,   0,   0,  10,  10,   0,   0,   0,
-        0,   0,   0,   0,   0,   0,   0,   0,
-        0,   0,   0,   0,   0,   0,   0,   0
-    };
+    static const int bishop_scores[64];
 
     // rook positional score
-    const int rook_scores[64] =
-    {
-        0,   0,   0,  20,  20,   0,   0,   0,
-        0,   0,  10,  20,  20,  10,   0,   0,
-        0,   0,  10,  20,  20,  10,   0,   0,
-        0,   0,  10,  20,  20,  10,   0,   0,
-        0,   0,  10,  20,  20,  10,   0,   0,
-        0,   0,  10,  20,  20,  10,   0,   0,
-        50,  50,  50,  50,  50,  50,  50,  50,
-        50,  50,  50,  50,  50,  50,  50,  50
-    };
+    static const int rook_scores[64];
 
     // king positional score
-    const int king_scores[64] = 
-    {
-        0,   0,   5,   0, -15,   0,  10,   0,
-        0,   5,   5,  -5,  -5,   0,   5,   0,
-        0,   0,   5,  10,  10,   5,   0,   0,
-        0,   5,  10,  20,  20,  10,   5,   0,
-        0,   5,  10,  20,  20,  10,   5,   0,
-        0,   5,   5,  10,  10,   5,   5,   0,
-        0,   0,   5,   5,   5,   5,   0,   0,
-        0,   0,   0,   0,   0,   0,   0,   0
-    };
+    static const int king_scores[64];
 
     // mirror positional score tables for opposite side
-    const int mirror_scores[128] =
-    {
-        a8, b8, c8, d8, e8, f8, g8, h8,
-        a7, b7, c7, d7, e7, f7, g7, h7,
-        a6, b6, c6, d6, e6, f6, g6, h6,
-        a5, b5, c5, d5, e5, f5, g5, h5,
-        a4, b4, c4, d4, e4, f4, g4, h4,
-        a3, b3, c3, d3, e3, f3, g3, h3,
-        a2, b2, c2, d2, e2, f2, g2, h2,
-        a1, b1, c1, d1, e1, f1, g1, h1,   
-    };
+    static const int mirror_scores[128];
 
     // MVV LVA [attacker][victim]
     static int mvv_lva[12][12];
 
     // killer moves [id][ply]
-    int killer_moves[2][64];
+    Move killer_moves[2][64];
 
     // history moves [piece][square]
     int history_moves[12][64];
+
+    // The quiet move that last refuted a move [piece][target square of the move refuted]
+    Move counter_moves[12][64];
+
+    // Piece moved and its target square at every ply of the line being searched (no_piece for a null move)
+    int moved_piece[max_ply];
+    int moved_to[max_ply];
+
+    // Returns the continuation history table of the move made the given number of plies before this node (nullptr
+    // if there is none, at the root or after a null move)
+    PieceToHistory *ContinuationHistory(int plies_back);
+
+    // Scores a quiet move by its history and continuation history
+    int QuietHistory(int move);
+
+    // Rewards the quiet move that failed high and penalizes the quiet moves searched before it without doing so
+    void UpdateQuietHistories(int move, Move *quiets_tried, int quiet_count, int depth);
     
     
 
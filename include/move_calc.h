@@ -2,39 +2,93 @@
 
 #pragma once
 
+// The PEXT slider backend needs the BMI2 instruction set, so it is only compiled into x86-64 builds (not WASM)
+#if defined(__x86_64__)
+#define PEXT_BACKEND
+#endif
+
+// Backends used to look up slider attacks. Magic multiplication works everywhere and is the fallback
+enum SliderBackend {magic_backend, pext_backend};
+
+/* Everything needed to look up the attacks of a slider on one square, packed into a single cache line so that a
+lookup touches one line for the entry plus one for the attack set */
+struct alignas(64) SliderEntry
+{
+    U64 mask = 0ULL;                    // relevant blocker squares (edges excluded)
+    U64 magic = 0ULL;                   // magic number that hashes the blockers into an index
+    const U64 *attacks = nullptr;       // this square's slice of the shared magic indexed attack table
+    const U64 *pext_attacks = nullptr;  // this square's slice of the shared PEXT indexed attack table
+    int shift = 0;                      // 64 - number of relevant bits
+};
+
+// Sums up how many attack sets a slider needs across all squares (2^relevant bits for each square)
+constexpr int AttackTableSize(const int relevant_bits[64])
+{
+    int size = 0;
+    for (int square = 0; square < 64; square++) size += 1 << relevant_bits[square];
+    return size;
+}
+
+#ifdef PEXT_BACKEND
+/* Parallel bit extract (BMI2). Written as inline asm rather than the _pext_u64 intrinsic so that it can be inlined
+into code that isn't compiled with -mbmi2. It is only ever executed once the CPU has been checked for support */
+inline U64 Pext(U64 source, U64 mask)
+{
+    U64 result;
+    asm("pextq %2, %1, %0" : "=r"(result) : "r"(source), "r"(mask));
+    return result;
+}
+#endif
 
 /* This class is in charge of anything relating to move calculation (not generation). It initializes
-all precalculated attack tables and has functionality for on the fly move calculation. This class
-should be used by the board class when performing move generation given the board state */
+all precalculated attack tables and has functionality for on the fly move calculation. Only one instance
+(move_calc below) exists per process. It is constructed at compile time, so the tables are baked into the
+read-only data of the executable and no table work happens when the engine starts */
 class MoveCalc
 {
 public:
-    // Class constructor
-    MoveCalc();
+    // Class constructor, evaluated by the compiler to build every table
+    constexpr MoveCalc();
 
     // Given a square and an occupancy bitboard, retrieves the slider attack map for that piece
-    U64 GetBishopAttacks(int square, U64 occupancy);
-    U64 GetRookAttacks(int square, U64 occupancy);
-    U64 GetQueenAttacks(int square, U64 occupancy);
+    U64 GetBishopAttacks(int square, U64 occupancy) const;
+    U64 GetRookAttacks(int square, U64 occupancy) const;
+    U64 GetQueenAttacks(int square, U64 occupancy) const;
+
+    // Slider attack lookups for one specific backend (the getters above dispatch to these)
+    U64 GetMagicBishopAttacks(int square, U64 occupancy) const;
+    U64 GetMagicRookAttacks(int square, U64 occupancy) const;
+#ifdef PEXT_BACKEND
+    U64 GetPextBishopAttacks(int square, U64 occupancy) const;
+    U64 GetPextRookAttacks(int square, U64 occupancy) const;
+#endif
+
+    // The slider backend in use, picked once at startup by querying the CPU
+    static int slider_backend;
+
+    // Cross-checks every backend against on the fly calculation for all occupancies, then benchmarks them
+    void TestSliderBackends() const;
 
 
     // Pre calculated knight and king attack tables
-    U64 knight_attacks[64];
-    U64 king_attacks[64];
+    U64 knight_attacks[64] = {};
+    U64 king_attacks[64] = {};
 
     // Precalculated pawn attack tables [side][square]
-    U64 pawn_attacks[2][64];
-        
-    // Initializes a list of magic numbers to be used in the program
-    void InitMagicNumbers(int bishop);
+    U64 pawn_attacks[2][64] = {};
 
+    /* Tables for squares that share a rank, file or diagonal [square][square]. between_squares holds the squares
+    strictly between the two, line_squares the whole line through both (edge to edge). Both are empty when the
+    squares aren't aligned. Used for check blocking and pinned piece movement */
+    U64 between_squares[64][64] = {};
+    U64 line_squares[64][64] = {};
 
 
 private:
 
     /* These are the maximum number of attack bits (edge exclusive) that we need to consider for a bishop
     or rook placed on each square */
-    const int bishop_relevant_bits[64] = {
+    static constexpr int bishop_relevant_bits[64] = {
         6, 5, 5, 5, 5, 5, 5, 6, 
         5, 5, 5, 5, 5, 5, 5, 5, 
         5, 5, 7, 7, 7, 7, 5, 5, 
@@ -44,7 +98,7 @@ private:
         5, 5, 5, 5, 5, 5, 5, 5, 
         6, 5, 5, 5, 5, 5, 5, 6
     };
-    const int rook_relevant_bits[64] = {
+    static constexpr int rook_relevant_bits[64] = {
         12, 11, 11, 11, 11, 11, 11, 12, 
         11, 10, 10, 10, 10, 10, 10, 11, 
         11, 10, 10, 10, 10, 10, 10, 11, 
@@ -57,7 +111,7 @@ private:
 
     /* Magic numbers for rooks and bishops, these numbers are used to obtain an index for pre-calculated
     sliding piece attacks */
-    const U64 rook_magic_numbers[64] = {
+    static constexpr U64 rook_magic_numbers[64] = {
         0x2080002010804002ULL,
         0x30c0011000402001ULL,
         0x4700084010200100ULL,
@@ -124,7 +178,7 @@ private:
         0x4002104008042ULL,
     };
 
-    const U64 bishop_magic_numbers[64] = {
+    static constexpr U64 bishop_magic_numbers[64] = {
         0x1140011802009025ULL,
         0x3148080800604800ULL,
         0x48020062040021ULL,
@@ -191,43 +245,119 @@ private:
         0x1840040400404100ULL
     };
 
-    // Contains possible rook and bishop attacks (excluding blockers) for all squares
-    U64 rook_masks[64];
-    U64 bishop_masks[64];
+    // Number of attack sets in the shared rook (102400) and bishop (5248) tables
+    static constexpr int rook_table_size = AttackTableSize(rook_relevant_bits);
+    static constexpr int bishop_table_size = AttackTableSize(bishop_relevant_bits);
+
+    // Per square lookup entries (mask, magic, shift and table slices) for rooks and bishops
+    SliderEntry rook_entries[64] = {};
+    SliderEntry bishop_entries[64] = {};
 
-    // Contains pre-initialized tables for all possible rook/bishop attacks on given squares
-    U64 rook_attacks    [64][4096];
-    U64 bishop_attacks  [64][512];
+    /* Shared attack tables for every square. Each square only gets the 2^relevant bits slots it needs, at a
+    variable offset, instead of a fixed 4096 (rook) or 512 (bishop) slots per square */
+    U64 rook_attacks[rook_table_size] = {};
+    U64 bishop_attacks[bishop_table_size] = {};
+
+#ifdef PEXT_BACKEND
+    // The same attacks indexed by PEXT(occupancy, mask) instead of the magic multiplication
+    U64 rook_pext_attacks[rook_table_size] = {};
+    U64 bishop_pext_attacks[bishop_table_size] = {};
+#endif
 
     
 
     /* Below functions used for magic bitboard sliding piece move calculation */
     // Given a square, returns an attack map of where the piece could attack (not including edge of board)
-    U64 MaskBishopAttacks(int square);
-    U64 MaskRookAttacks(int square);
+    static constexpr U64 MaskBishopAttacks(int square);
+    static constexpr U64 MaskRookAttacks(int square);
 
     /* Given a square and a bitboard of blockers returns an attack map of where the piece could attack, blocked by
     blocker pieces*/
-    U64 BishopAttacksOnTheFly(int square, U64 block);
-    U64 RookAttacksOnTheFly(int square, U64 block);
-
-    // Constructs a potential set of blockers for a given index and attack mask
-    U64 SetOccupancy(int index, int bits_in_mask, U64 attack_mask);
+    static constexpr U64 BishopAttacksOnTheFly(int square, U64 block);
+    static constexpr U64 RookAttacksOnTheFly(int square, U64 block);
 
     // Pre-calculates rook and bishop attack tables
-    void InitSliderMoves(int bishop);
+    constexpr void InitSliderMoves(int bishop);
 
     // Pre calculates knight and rook moves
-    void InitLeaperMoves();
+    constexpr void InitLeaperMoves();
+
+    // Pre calculates the between and line tables
+    constexpr void InitLineTables();
 
     //Given a square and a color, calculates where that pawn could attack
-    U64 CalcPawnAttacks(int square, int side);
+    static constexpr U64 CalcPawnAttacks(int square, int side);
 
     // Given a square, calculates where the king could attack
-    U64 CalcKingAttacks(int square);
+    static constexpr U64 CalcKingAttacks(int square);
 
     // Given a square, calculates where the knight could attack
-    U64 CalcKnightAttacks(int square);
+    static constexpr U64 CalcKnightAttacks(int square);
 
-    U64 FindMagicNumber(int square, int relevant_bits, int bishop);
+    // Asks the CPU whether it supports PEXT at all, and whether it is fast enough to use as the slider backend
+    static bool CpuHasPext();
+    static int DetectSliderBackend();
 };
+
+// Process-wide attack tables, shared by all boards (and threads) since they never change
+extern const MoveCalc move_calc;
+
+/* Uses magic bitboard technique to get bishop attacks */
+inline U64 MoveCalc::GetMagicBishopAttacks(int square, U64 occupancy) const
+{ 
+    const SliderEntry &entry = bishop_entries[square];
+
+    // Keep the relevant blockers, hash them with the magic number and keep only the relevant bits as the index
+    return entry.attacks[((occupancy & entry.mask) * entry.magic) >> entry.shift];
+}
+
+/* Uses magic bitboard technique to get rook attacks */
+inline U64 MoveCalc::GetMagicRookAttacks(int square, U64 occupancy) const
+{ 
+    const SliderEntry &entry = rook_entries[square];
+
+    // Keep the relevant blockers, hash them with the magic number and keep only the relevant bits as the index
+    return entry.attacks[((occupancy & entry.mask) * entry.magic) >> entry.shift];
+}
+
+#ifdef PEXT_BACKEND
+/* Uses PEXT to gather the relevant blockers straight into an index for bishop attacks */
+inline U64 MoveCalc::GetPextBishopAttacks(int square, U64 occupancy) const
+{
+    const SliderEntry &entry = bishop_entries[square];
+    return entry.pext_attacks[Pext(occupancy, entry.mask)];
+}
+
+/* Uses PEXT to gather the relevant blockers straight into an index for rook attacks */
+inline U64 MoveCalc::GetPextRookAttacks(int square, U64 occupancy) const
+{
+    const SliderEntry &entry = rook_entries[square];
+    return entry.pext_attacks[Pext(occupancy, entry.mask)];
+}
+#endif
+
+/* Gets bishop attacks from whichever backend was chosen at startup */
+inline U64 MoveCalc::GetBishopAttacks(int square, U64 occupancy) const
+{
+#ifdef PEXT_BACKEND
+    if (slider_backend == pext_backend)
+        return GetPextBishopAttacks(square, occupancy);
+#endif
+    return GetMagicBishopAttacks(square, occupancy);
+}
+
+/* Gets rook attacks from whichever backend was chosen at startup */
+inline U64 MoveCalc::GetRookAttacks(int square, U64 occupancy) const
+{
+#ifdef PEXT_BACKEND
+    if (slider_backend == pext_backend)
+        return GetPextRookAttacks(square, occupancy);
+#endif
+    return GetMagicRookAttacks(square, occupancy);
+}
+
+/* Uses the union of rook and bishop attacks to construct a queen attack */
+inline U64 MoveCalc::GetQueenAttacks(int square, U64 occupancy) const
+{
+    return GetRookAttacks(square, occupancy) | GetBishopAttacks(square, occupancy);
+}
@@ -0,0 +1,93 @@
+#include "utils.h"
+#include "board.h"
+
+#pragma once
+
+
+/* Hands out the moves of a position one at a time, best guesses first, generating them in stages so that a beta
+cutoff early on saves generating the rest. The order is the hash move, then captures and promotions (most valuable
+victim first), then the killer moves, then the countermove to the opponent's last move, then every other quiet move
+by its history, and last the captures that lose material by static exchange evaluation. When the side to move is in
+check all the evasions are generated and ordered in a single stage instead. Quiescence uses a picker that stops after
+the captures and leaves out the losing ones.
+
+Each stage's moves are scored once when they are generated, but never sorted: every call picks the best of the moves
+left with one scan. A cutoff on the first move of a stage then costs a single pass over its moves instead of a full
+sort */
+class MovePicker
+{
+
+public:
+
+    // Sets up a picker for the board's current position. hash_move is tried first if it is legal (0 for none)
+    MovePicker(Board *board, int hash_move, bool in_check);
+
+    // Sets up a picker that only hands out captures and promotions, for quiescence. hash_move is tried first if it is
+    // a legal capture or promotion
+    MovePicker(Board *board, int hash_move);
+
+    // Returns the next move to search, or 0 once every move has been handed out
+    int NextMove();
+
+private:
+
+    // The stages the picker steps through, in order
+    enum
+    {
+        hash_stage,
+        init_captures_stage,
+        captures_stage,
+        first_killer_stage,
+        second_killer_stage,
+        counter_move_stage,
+        init_quiets_stage,
+        quiets_stage,
+        bad_captures_stage,
+        init_evasions_stage,
+        evasions_stage,
+        done_stage
+    };
+
+    // board the moves are picked for
+    Board *board;
+
+    // current stage
+    int stage;
+
+    // whether the side to move is in check
+    bool in_check;
+
+    // whether only captures and promotions are handed out
+    bool captures_only;
+
+    // hash move, the two killer moves of this ply and the countermove, taken out of the later stages once tried
+    int hash_move;
+    int killers[2];
+    int counter_move;
+
+    // captures put off by the captures stage because they lose material, and the next one to hand out
+    MoveList bad_captures;
+    int bad_index;
+
+    // moves of the current stage, their scores and the index of the next one to hand out. The moves before index
+    // were handed out already
+    MoveList move_list;
+    int scores[max_moves];
+    int index;
+
+    // Scores the moves of the current stage: quiet moves by history only (the killers and countermove already had
+    // their stages), captures and evasions by the board's ScoreMove
+    void ScoreMoves(bool quiets);
+
+    // Returns the best scored move not handed out yet, swapping it to the front of the ones left
+    int PickBest();
+
+    // true if the capture or promotion loses material once the exchanges on its target square are played out
+    bool IsLosingCapture(int move);
+
+    // true if the killer move or countermove should be tried in its stage
+    bool IsQuietRefutation(int move);
+
+    // true if the move was already handed out by the hash, killer or countermove stage
+    bool AlreadyTried(int move);
+};
@@ -0,0 +1,13 @@
+#include <string>
+
+#pragma once
+
+
+/* Runs every position of an EPD perft suite and compares the node counts to the expected ones. Each line of the file
+is a FEN followed by the expected counts, e.g.
+
+    rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - ;D1 20 ;D2 400 ;D3 8902
+
+Depths above max_depth are skipped (0 runs them all). Prints the result and speed of every position and the totals,
+and returns true if every count matched */
+bool RunPerftSuite(std::string path, int max_depth = 0, int threads = 1, int hash_mb = 0);
@@ -0,0 +1,49 @@
+#include <vector>
+#include <atomic>
+#include "utils.h"
+
+#pragma once
+
+
+/* Hash table for perft that maps a (position key, depth) pair to the number of nodes under it, so that a
+transposition reached again is counted with one lookup instead of walking its subtree a second time.
+
+The table is shared by all perft threads without any locks. Each entry is two 64-bit words, the packed data (node
+count and depth) and the key XORed with that data. Two threads writing the same entry at once can leave the words of
+different stores side by side, but then the key no longer XORs back out and the probe simply misses */
+class PerftTable
+{
+
+public:
+
+    // Allocates a table of (about) the given size in megabytes, rounded down to a power of two number of buckets
+    PerftTable(int megabytes);
+
+    // Looks up the node count of a position at a depth. Returns true and sets nodes if it was found
+    bool Probe(U64 key, int depth, U64 &nodes);
+
+    // Stores the node count of a position at a depth
+    void Store(U64 key, int depth, U64 nodes);
+
+private:
+
+    // node count in the upper 56 bits, depth in the lower 8
+    struct Entry
+    {
+        std::atomic<U64> check{0};    // key ^ data
+        std::atomic<U64> data{0};
+    };
+
+    // Buckets of two entries: the first keeps the deepest result it has seen (the most work saved), the second
+    // always takes the newest
+    struct Bucket
+    {
+        Entry deepest;
+        Entry newest;
+    };
+
+    std::vector<Bucket> buckets;
+
+    // bucket count - 1, used to index with the low bits of the key
+    U64 mask;
+};
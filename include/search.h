@@ -0,0 +1,119 @@
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "utils.h"
+#include "board.h"
+#include "thread_pool.h"
+#include "time_manager.h"
+
+#pragma once
+
+
+// What the go command asked for
+struct SearchLimits
+{
+    int depth = max_ply - 1;    // deepest iteration to search
+    int move_time = 0;          // milliseconds to search for (0 for no time limit)
+    int time[2] = {0, 0};       // time left on each side's clock in milliseconds (wtime, btime), 0 if not given
+    int increment[2] = {0, 0};  // increment of each side per move in milliseconds (winc, binc)
+    int moves_to_go = 0;        // moves until the next time control (0 if the rest of the game)
+    bool infinite = false;      // keep searching until stop
+    bool ponder = false;        // searching on the opponent's time until ponderhit or stop
+};
+
+
+/* Runs the engine's search on one or more threads (Lazy SMP). Every thread searches the same position with iterative
+deepening on its own copy of the board, so each has its own search stack (ply, PV table, killer moves). They share
+nothing but the transposition table: what one thread stores, the others find and take as cutoffs or move ordering,
+and that sharing is where the speedup comes from. Half of the helpers search one ply deeper than the main thread to
+spread the threads over the tree instead of having them all walk it in step.
+
+The search runs in the background, so the UCI loop keeps reading commands while it does. The main thread decides when
+the search is over and prints the info lines. The best move is taken from whichever thread finished the deepest
+iteration (the main thread on a tie). An infinite or ponder search doesn't report its move until it is told to stop
+(or ponderhit), even if it runs out of depth before then */
+class Search
+{
+
+public:
+
+    // Sets up a single-threaded search
+    Search();
+
+    // Stops any search that is still running
+    ~Search();
+
+    // Sets the number of threads that search together (stopping any search first)
+    void SetThreads(int count);
+
+    // Starts searching the board's position in the background, printing info lines and the bestmove once done.
+    // Any search still running is stopped first
+    void Start(Board &board, SearchLimits search_limits);
+
+    // Stops the search and waits for it to print its bestmove. Does nothing if no search is running
+    void Stop();
+
+    // The opponent played the pondered move: carry on as a normal search, timed from now (ignored unless pondering)
+    void PonderHit();
+
+    // Waits for the search to finish by itself
+    void Wait();
+
+    // Total nodes of every thread up to their last finished iteration
+    U64 TotalNodes();
+
+    // Beta cutoffs of every thread in the last search, and how many came from the first move searched. Only
+    // meaningful once the search has finished
+    void CutoffCounts(U64 &cutoffs, U64 &first_move_cutoffs);
+
+private:
+
+    // What a thread found in its deepest finished iteration
+    struct Result
+    {
+        int depth = 0;
+        int score = 0;
+        std::vector<Move> pv;
+    };
+
+    // the threads running the search, one board, node count and result each
+    std::unique_ptr<ThreadPool> pool;
+    std::vector<Board> boards;
+    std::vector<std::atomic<U64>> thread_nodes;
+    std::vector<Result> results;
+
+    // continuation history of every thread, allocated with the threads and cleared for each search
+    std::vector<std::vector<Board::PieceToHistory>> continuation_histories;
+
+    // guards results
+    std::mutex results_lock;
+
+    // the thread the whole search runs in, so the caller of Start can get on with reading commands
+    std::thread search_thread;
+
+    // set by the main thread when it is done (or by Stop), every thread stops searching when it is
+    std::atomic<bool> stop{false};
+
+    // limits of the current search, infinite is cleared by Stop while it runs
+    SearchLimits limits;
+    std::atomic<bool> infinite{false};
+
+    // how long the search may take, the main thread's board aborts the search on its hard limit
+    TimeManager time_manager;
+
+    // wakes a main thread waiting for stop or ponderhit once it has nothing left to search
+    std::mutex wait_lock;
+    std::condition_variable wake;
+
+    // Runs every thread's search and reports the best result, in the search thread
+    void Run();
+
+    // Iterative deepening loop run by each thread (thread 0 is the main thread)
+    void IterativeDeepening(int index);
+
+    // Prints an info line for a result
+    void PrintInfo(Result &result);
+};
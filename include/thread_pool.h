@@ -0,0 +1,64 @@
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+#pragma once
+
+
+/* A fixed set of worker threads that run batches of tasks. Every worker has its own task queue: it takes tasks from
+the back of its own queue and, once that is empty, steals from the front of the other workers' queues, so a worker
+that drew short tasks helps out with everyone else's instead of sitting idle. Tasks are given the index of the worker
+running them so they can use per-worker state (such as a board of their own) without locking */
+class ThreadPool
+{
+
+public:
+
+    // Starts the given number of worker threads
+    ThreadPool(int thread_count);
+
+    // Stops and joins the workers
+    ~ThreadPool();
+
+    // Runs every task of the batch on the workers and returns once they have all finished
+    void Run(std::vector<std::function<void(int)>> &tasks);
+
+    // Number of worker threads
+    int Size() const { return (int)workers.size(); }
+
+private:
+
+    // One worker's queue of task indices, with the lock guarding it
+    struct TaskQueue
+    {
+        std::mutex lock;
+        std::deque<int> tasks;
+    };
+
+    // Worker threads and their queues (one each)
+    std::vector<std::thread> workers;
+    std::vector<TaskQueue> queues;
+
+    // The batch being run, and how many of its tasks haven't finished yet
+    std::vector<std::function<void(int)>> *batch = nullptr;
+    std::atomic<int> pending{0};
+
+    // Counts the batches handed out, workers wake up when it changes (or when stopping is set)
+    int batch_number = 0;
+    bool stopping = false;
+
+    // Guards batch_number and stopping and wakes the workers up and the caller of Run when a batch is done
+    std::mutex state_lock;
+    std::condition_variable batch_started;
+    std::condition_variable batch_finished;
+
+    // The loop each worker thread runs
+    void WorkerLoop(int index);
+
+    // Takes the next task for a worker, from its own queue or stolen from another one. Returns false if none is left
+    bool TakeTask(int index, int &task);
+};
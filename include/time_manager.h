@@ -0,0 +1,65 @@
+#include <atomic>
+#include "utils.h"
+
+#pragma once
+
+
+/* Decides how long the search may think about a move. From the clock it works out two limits:
+
+    soft: the time the move should take, checked between iterations. It is scaled up while the best move keeps
+          changing or the score is dropping (the search hasn't made up its mind, or is finding trouble), and down
+          while the best move stays put
+    hard: the time the move may never exceed, checked inside the search, which is aborted when it is reached
+
+With movetime both limits are that time, less the move overhead. Without either there is no limit (go ponder
+without a clock is then searched as go infinite, until stop). While pondering the clock doesn't run, it starts over
+at ponderhit */
+class TimeManager
+{
+
+public:
+
+    // Safety margin in milliseconds kept back from the clock for the GUI and the connection (Move Overhead option)
+    static int move_overhead;
+
+    // Works out the limits for a search. time and increment are the clocks of both sides in milliseconds, indexed
+    // by color, moves_to_go is how many moves are left until the next time control (0 if none)
+    void Start(Color side, int time[2], int increment[2], int moves_to_go, int move_time, bool ponder);
+
+    // Starts the clock after pondering (ignored unless pondering)
+    void PonderHit();
+
+    // Whether the search is pondering (no clock running)
+    bool Pondering() { return pondering; }
+
+    // Milliseconds since the search started (or since ponderhit)
+    long long Elapsed();
+
+    // True if the search has to be aborted now. Called inside the search, so it only looks at the clock
+    bool HardLimitReached();
+
+    // Called after every finished iteration with its best move and score (for the side to move). Returns true if
+    // another iteration shouldn't be started
+    bool SoftLimitReached(int best_move, int score);
+
+private:
+
+    // the limits in milliseconds, 0 when there is none
+    long long soft_limit = 0;
+    long long hard_limit = 0;
+
+    // whether the soft limit is scaled by the best move's stability and the score (only when playing on a clock)
+    bool scaled = false;
+
+    // when the clock started, in steady clock milliseconds, and whether it is running yet
+    std::atomic<long long> start_time{0};
+    std::atomic<bool> pondering{false};
+
+    // the last iteration's best move and score, and for how many iterations in a row the best move hasn't changed
+    int last_move = 0;
+    int last_score = 0;
+    int stable_iterations = 0;
+
+    // Current steady clock time in milliseconds
+    static long long Now();
+};
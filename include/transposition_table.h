@@ -0,0 +1,98 @@
+#include <vector>
+#include <atomic>
+#include "utils.h"
+
+#pragma once
+
+
+// What a stored score says about the real score: exact, at most the score (failed low) or at least it (failed high)
+enum {hash_exact, hash_alpha, hash_beta};
+
+// What a probe of the table found
+struct HashEntry
+{
+    Move move;      // best move found in the position (0 if none)
+    int score;      // score, relative to the node it was stored from (see ScoreFromTable)
+    int depth;      // depth the position was searched to
+    int flag;       // hash_exact, hash_alpha or hash_beta
+};
+
+
+/* Transposition table for the search. It remembers the result of every searched position by its Zobrist key, so a
+position reached again (by another move order, or in the next search) can reuse it: cut off straight away if it was
+searched deep enough, or at least try the best move found last time first.
+
+Entries come in buckets of four, one cache line each. A new result replaces the entry of the same position, or
+else the entry least worth keeping, the shallowest taking into account how many searches ago it was stored.
+
+Like the perft table it is shared by every search thread without locks: each entry keeps the key XORed with its
+data, so an entry torn by two threads writing it at once just fails to match */
+class TranspositionTable
+{
+
+public:
+
+    // Allocates a table of (about) the given size in megabytes
+    TranspositionTable(int megabytes);
+
+    // Reallocates the table at a new size, which also clears it
+    void Resize(int megabytes);
+
+    // Empties the table
+    void Clear();
+
+    // Starts a new search, so older entries are replaced before those of this search
+    void NewSearch();
+
+    // Looks a position up, returns true and fills in entry if it was found
+    bool Probe(U64 key, HashEntry &entry);
+
+    // Stores the result of a search of a position
+    void Store(U64 key, int depth, int flag, int score, int move);
+
+private:
+
+    // move in bits 0-15, score + score_offset in bits 16-33, depth in bits 34-41, flag in bits 42-43 and the
+    // search it was stored in, in bits 44-49
+    struct Entry
+    {
+        std::atomic<U64> check{0};    // key ^ data
+        std::atomic<U64> data{0};
+    };
+
+    struct alignas(64) Bucket
+    {
+        Entry entries[4];
+    };
+
+    // scores are stored with this added so they are never negative
+    static const int score_offset = 1 << 17;
+
+    std::vector<Bucket> buckets;
+
+    // bucket count - 1, used to index with the low bits of the key
+    U64 mask;
+
+    // counts the searches (mod 64), stored with each entry to tell old entries from new ones
+    int generation = 0;
+};
+
+
+/* Mate scores count plies from the root, but a stored position may be reached at another ply later. They are stored
+counting from the position itself instead, and turned back when probed at whatever ply the position is reached */
+constexpr int ScoreToTable(int score, int ply)
+{
+    if (score > mate_score) return score + ply;
+    if (score < -mate_score) return score - ply;
+    return score;
+}
+
+constexpr int ScoreFromTable(int score, int ply)
+{
+    if (score > mate_score) return score - ply;
+    if (score < -mate_score) return score + ply;
+    return score;
+}
+
+// The table shared by every search
+extern TranspositionTable transposition_table;
@@ -71,20 +71,64 @@ enum enumSquare{
     a8, b8, c8, d8, e8, f8, g8, h8, no_sq,
 };
 
-// Constructs a move list with maximum number as 256 moves and a count to keep track of how many are stored so far
+// Maximum search depth in plies, sizes the PV table, killer moves and the undo stack
+const int max_ply = 64;
+
+// Search scores: infinity bounds every score, mate_value is the score of being mated at the root (mate in n plies
+// scores mate_value - n) and any score beyond mate_score is a mate
+const int infinity = 50000;
+const int mate_value = 49000;
+const int mate_score = 48000;
+
+/* The kind of node NegaMax expects a position to be. A PV node is searched with an open window and its score is
+exact, a cut node is expected to fail high (one move is enough) and an all node to fail low (every move is searched
+and none raises alpha). The children of a cut node are all nodes and the other way round */
+enum {pv_node, cut_node, all_node};
+
+/* A move packed into 16 bits: source square (bits 0-5), target square (bits 6-11) and a moveType flag (bits
+12-15). Everything else about the move (which piece moves, what it captures) is read off the board. 0 is never a
+real move (a1 to a1) so it is used to mean no move */
+typedef uint16_t Move;
+
+// A move together with the score used to order it
+struct ScoredMove
+{
+    Move move;
+    int score;
+};
+
+// Largest number of moves a move list can hold (no legal position has more than 218)
+const int max_moves = 256;
+
+/* Holds up to max_moves moves and a count of how many are stored so far. The moves live in a plain array so a move
+list on the stack costs nothing to create: no allocation and the unused slots are never touched. begin() and end()
+cover the stored moves, so a move list can be looped over with a range-based for */
 struct MoveList{
-        std::vector<int> moves = std::vector<int>(256);
+        Move moves[max_moves];
         int count = 0;
+
+        Move *begin() { return moves; }
+        Move *end() { return moves + count; }
     };
 
+/* Move flags, stored in the top 4 bits of a move. Bit 2 (4) marks captures and bit 3 (8) promotions, whose low two
+bits give the promoted piece (knight, bishop, rook, queen) */
 enum moveType
 {
-    quiet,
-    double_pawn_push,
-    capture,
-    ep_capture,
-    castle,
-    promotion
+    quiet_move = 0,
+    double_pawn_push = 1,
+    king_castle = 2,
+    queen_castle = 3,
+    capture_move = 4,
+    ep_capture = 5,
+    knight_promotion = 8,
+    bishop_promotion = 9,
+    rook_promotion = 10,
+    queen_promotion = 11,
+    knight_promotion_capture = 12,
+    bishop_promotion_capture = 13,
+    rook_promotion_capture = 14,
+    queen_promotion_capture = 15
 };
 
 // These are castle bits
@@ -102,34 +146,38 @@ enum Color{white, black, both};
 // Encode rook vs. bishop for sliding piece move generation
 enum {rook, bishop};
 
-// Encode pieces for reference in bitboards
-enum {P, N, B, R, Q, K, p, n, b, r, q, k};
+// Encode pieces for reference in bitboards (no_piece marks an empty square or no capture)
+enum {P, N, B, R, Q, K, p, n, b, r, q, k, no_piece};
 
-// Move types, used for quiescence search
-enum {all_moves, only_captures};
+/* Board state that MakeMove overwrites and that can't be recovered from the move itself. One of these is pushed
+for every move made so that UnmakeMove can restore it */
+struct UndoInfo
+{
+    int captured_piece;     // piece taken by the move (no_piece if it wasn't a capture)
+    int enpassant;          // en passant square before the move
+    int castling_rights;    // castling rights before the move
+    U64 hash_key;           // Zobrist key of the position before the move
+};
+
+/* Kinds of moves GenerateMoves can be asked for. only_captures also includes promotions (both are what quiescence
+searches), only_quiets is everything else. evasions is for when the side to move is in check, where every legal
+move has to deal with the check so the list is generated in one go */
+enum {all_moves, only_captures, only_quiets, evasions};
 
 //Macro that returns the bit of the bitboard at the square
-#define get_bit(bitboard, square)(bitboard & (1ULL << square))
+#define get_bit(bitboard, square)((bitboard) & (1ULL << (square)))
 
 // Macro that sets a bit to 1 at a particular square
-#define set_bit(bitboard, square)(bitboard |= (1ULL << square))
+#define set_bit(bitboard, square)(bitboard |= (1ULL << (square)))
 
 // Macro that pops a bit to 0 at a particular square
-#define pop_bit(bitboard, square)(bitboard &= ~(1ULL << square))
+#define pop_bit(bitboard, square)(bitboard &= ~(1ULL << (square)))
 
 #define count_bits(bitboard) __builtin_popcountll(bitboard)
 
 /* Define macros that encode and decode move information */
-// Macro that takes in all information about a move and encodes it into an integer 
-#define encode_move(source, target, piece, promoted, capture, double, enpassant, castling) \
-    (source) |          \
-    (target << 6) |     \
-    (piece << 12) |     \
-    (promoted << 16) |  \
-    (capture << 20)   | \
-    (double << 21)   |  \
-    (enpassant << 22) | \
-    (castling << 23)    \
+// Macro that packs a source square, target square and moveType flag into a move
+#define encode_move(source, target, flag) ((source) | ((target) << 6) | ((flag) << 12))
 
 // extract source square
 #define get_move_source(move) (move & 0x3f)
@@ -137,26 +185,34 @@ enum {all_moves, only_captures};
 // extract target square
 #define get_move_target(move) ((move & 0xfc0) >> 6)
 
-// extract piece
-#define get_move_piece(move) ((move & 0xf000) >> 12)
+// extract the moveType flag
+#define get_move_flag(move) ((move & 0xf000) >> 12)
 
-// extract promoted piece
-#define get_move_promoted(move) ((move & 0xf0000) >> 16)
+// extract promoted piece, as a white piece (N, B, R or Q), or 0 if the move isn't a promotion
+#define get_move_promoted(move) ((move & 0x8000) ? (((move & 0x3000) >> 12) + N) : 0)
 
-// extract capture flag
-#define get_move_capture(move) (move & 0x100000)
+// extract capture flag (set for en passant and capture promotions too)
+#define get_move_capture(move) (move & 0x4000)
 
 // extract double pawn push flag
-#define get_move_double(move) (move & 0x200000)
+#define get_move_double(move) (get_move_flag(move) == double_pawn_push)
 
 // extract enpassant flag
-#define get_move_enpassant(move) (move & 0x400000)
+#define get_move_enpassant(move) (get_move_flag(move) == ep_capture)
+
+// extract castling flag (king_castle or queen_castle)
+#define get_move_castling(move) ((move & 0xe000) == 0x2000)
+
+/* Helper function used to find the least significant bit (rightmost) of a bitboard. Defined here
+(and constexpr) so that it inlines into move generation and can be used to build tables at compile time */
+constexpr int BitScan(U64 bitboard){
 
-// extract castling flag
-#define get_move_castling(move) (move & 0x800000)
+    // return the bitscan to get least significant bit using a built in function
+    return __builtin_ffsll(bitboard) - 1;
+}
 
-// Helper functions that finds index of LSB
-int BitScan(U64 bitboard);
+// Returns a move in UCI format (e7e8q)
+std::string MoveString(int move);
 
 // Prints a move to stdout and also returns that move
 std::string PrintMove(int move);
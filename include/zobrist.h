@@ -0,0 +1,28 @@
+#include "utils.h"
+
+#pragma once
+
+
+/* Random keys for Zobrist hashing. A position's hash key is the XOR of the keys of everything in it: every piece on
+its square, the castling rights, the en passant square (if any) and the side to move (if black). Moving a piece
+then only takes a couple of XORs to update the key */
+struct ZobristKeys
+{
+    // Fills the tables from a fixed-seed generator, at compile time
+    constexpr ZobristKeys();
+
+    // keys for each piece on each square [piece][square]
+    U64 piece_keys[12][64] = {};
+
+    // keys for the en passant square
+    U64 enpassant_keys[64] = {};
+
+    // keys for each combination of the four castling rights
+    U64 castle_keys[16] = {};
+
+    // key XORed in when black is to move
+    U64 side_key = 0ULL;
+};
+
+// Process-wide Zobrist keys, built into the executable like the attack tables
+extern const ZobristKeys zobrist_keys;
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+#include "bench.h"
+#include "board.h"
+#include "transposition_table.h"
+
+using namespace std;
+
+
+// Openings, middlegames and endgames, with some tactics, checks and promotions among them
+static const string bench_positions[] =
+{
+    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+    "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4",
+    "r2q1rk1/pp2bppp/2n1pn2/3p4/3P4/2NBPN2/PP3PPP/R2Q1RK1 w - - 0 10",
+    "2rq1rk1/pp1bppbp/2np1np1/8/3NP3/1BN1BP2/PPPQ2PP/2KR3R b - - 0 11",
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+    "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10",
+    "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+    "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+    "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",
+    "8/8/4kpp1/3p1b2/p6P/2B5/6P1/6K1 b - - 2 47",
+    "6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+    "8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+};
+
+
+/* Runs the search on every position, waiting for each to finish, and adds up the nodes and time */
+void RunBench(Search &search, int depth)
+{
+    U64 total_nodes = 0;
+    double total_seconds = 0;
+
+    // beta cutoffs and those on the first move, showing how well the moves are ordered
+    U64 total_cutoffs = 0;
+    U64 total_first_move_cutoffs = 0;
+
+    SearchLimits limits;
+    limits.depth = depth;
+
+    for (const string &fen : bench_positions)
+    {
+        cout << "position fen " << fen << endl;
+
+        // every position starts from nothing, so the result doesn't depend on what was searched before
+        Board board(fen);
+        transposition_table.Clear();
+
+        auto start = chrono::steady_clock::now();
+        search.Start(board, limits);
+        search.Wait();
+
+        total_seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        total_nodes += search.TotalNodes();
+
+        U64 cutoffs, first_move_cutoffs;
+        search.CutoffCounts(cutoffs, first_move_cutoffs);
+        total_cutoffs += cutoffs;
+        total_first_move_cutoffs += first_move_cutoffs;
+    }
+
+    // the table is left empty for whatever comes next
+    transposition_table.Clear();
+
+    cout << endl << "nodes searched: " << total_nodes << endl;
+    cout << "total time: " << total_seconds << " seconds" << endl;
+    cout << (U64)(total_nodes / total_seconds) << " nodes per second" << endl;
+    cout << "beta cutoffs: " << total_cutoffs << ", on the first move: "
+         << 100.0 * total_first_move_cutoffs / max(total_cutoffs, (U64)1) << "%" << endl;
+}
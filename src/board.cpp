@@ -10,10 +10,20 @@
 #include <ctime>
 #include <vector>
 #include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cmath>
+#include <array>
 
 #include "utils.h"
 #include "board.h"
 #include "move_calc.h"
+#include "zobrist.h"
+#include "transposition_table.h"
+#include "move_picker.h"
+#include "thread_pool.h"
 
 
 using namespace std;
@@ -37,6 +47,97 @@ int Board::mvv_lva[12][12] =
     {100, 200, 300, 400, 500, 600,  100, 200, 300, 400, 500, 600}
 };
 
+// Castling rights masks for every square, &'ed with the castling rights whenever a move touches that square
+const int Board::board_castling_rights[64] =
+{
+    13, 15, 15, 15,  12, 15, 15, 14,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,
+     7, 15, 15, 15,  3, 15, 15, 11
+};
+
+// pawn positional score
+const int Board::pawn_scores[64] =
+{
+    0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0, -10, -10,   0,   0,   0,
+    0,   0,   0,   5,   5,   0,   0,   0,
+    5,   5,  10,  20,  20,   5,   5,   5,
+    10,  10,  10,  20,  20,  10,  10,  10,
+    20,  20,  20,  30,  30,  30,  20,  20,
+    30,  30,  30,  40,  40,  30,  30,  30,
+    90,  90,  90,  90,  90,  90,  90,  90
+};
+
+// knight positional score
+const int Board::knight_scores[64] =
+{
+    -5, -10,   0,   0,   0,   0, -10,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5,
+    -5,   5,  20,  10,  10,  20,   5,  -5,
+    -5,  10,  20,  30,  30,  20,  10,  -5,
+    -5,  10,  20,  30,  30,  20,  10,  -5,
+    -5,   5,  20,  20,  20,  20,   5,  -5,
+    -5,   0,   0,  10,  10,   0,   0,  -5,
+    -5,   0,   0,   0,   0,   0,   0,  -5
+};
+
+// bishop positional score
+const int Board::bishop_scores[64] =
+{
+    0,   0, -10,   0,   0, -10,   0,   0,
+    0,  30,   0,   0,   0,   0,  30,   0,
+    0,  10,   0,   0,   0,   0,  10,   0,
+    0,   0,  10,  20,  20,  10,   0,   0,
+    0,   0,  10,  20,  20,  10,   0,   0,
+    0,   0,   0,  10,  10,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0
+};
+
+// rook positional score
+const int Board::rook_scores[64] =
+{
+    0,   0,   0,  20,  20,   0,   0,   0,
+    0,   0,  10,  20,  20,  10,   0,   0,
+    0,   0,  10,  20,  20,  10,   0,   0,
+    0,   0,  10,  20,  20,  10,   0,   0,
+    0,   0,  10,  20,  20,  10,   0,   0,
+    0,   0,  10,  20,  20,  10,   0,   0,
+    50,  50,  50,  50,  50,  50,  50,  50,
+    50,  50,  50,  50,  50,  50,  50,  50
+};
+
+// king positional score
+const int Board::king_scores[64] =
+{
+    0,   0,   5,   0, -15,   0,  10,   0,
+    0,   5,   5,  -5,  -5,   0,   5,   0,
+    0,   0,   5,  10,  10,   5,   0,   0,
+    0,   5,  10,  20,  20,  10,   5,   0,
+    0,   5,  10,  20,  20,  10,   5,   0,
+    0,   5,   5,  10,  10,   5,   5,   0,
+    0,   0,   5,   5,   5,   5,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0
+};
+
+// mirror positional score tables for opposite side
+const int Board::mirror_scores[128] =
+{
+    a8, b8, c8, d8, e8, f8, g8, h8,
+    a7, b7, c7, d7, e7, f7, g7, h7,
+    a6, b6, c6, d6, e6, f6, g6, h6,
+    a5, b5, c5, d5, e5, f5, g5, h5,
+    a4, b4, c4, d4, e4, f4, g4, h4,
+    a3, b3, c3, d3, e3, f3, g3, h3,
+    a2, b2, c2, d2, e2, f2, g2, h2,
+    a1, b1, c1, d1, e1, f1, g1, h1,   
+};
+
 // Constructor for board, initializes board position and game state (en passant, castling, etc...)
 Board::Board(){
 
@@ -70,6 +171,20 @@ Board::Board(){
 
     // Sets castling rights such that all castling is available at the start (no pieces have moved)
     castling_rights = wk | wq | bk | bq;
+
+    // No moves have been made yet
+    undo_count = 0;
+
+    // Fill in the mailbox from the piece bitboards
+    for (int square = 0; square < 64; square++)
+    {
+        piece_on[square] = no_piece;
+        for (int piece = P; piece <= k; piece++)
+            if (get_bit(pieces[piece], square)) piece_on[square] = piece;
+    }
+
+    // hash the starting position
+    hash_key = GenerateHashKey();
 }
 
 /* Initializes a board with an FEN String by calling the SetFEN function */
@@ -87,6 +202,7 @@ void Board::SetFEN(string fen_string){
     // Initialize the piece and occupancy bitboards as empty as empty
     for (int i = 0; i < 12; i++)    pieces[i] = 0ULL;
     for (int i = 0; i< 3; i++)      occupancies[i] = 0ULL;
+    for (int i = 0; i < 64; i++)    piece_on[i] = no_piece;
 
     // Initializes the castling rights as 0
     castling_rights = 0;
@@ -94,6 +210,9 @@ void Board::SetFEN(string fen_string){
     // Initialize no en passant square
     enpassant = no_sq;
 
+    // A new position has no moves to take back
+    undo_count = 0;
+
     // A string to find which piece in the FEN string corresponds to which bitboard
     string piece_tokens = "PNBRQKpnbrqk";
 
@@ -131,7 +250,11 @@ void Board::SetFEN(string fen_string){
             for (unsigned int i = 0; i < piece_tokens.length(); i++)
             {   
                 // If the token in the FEN string matches the piece token, assign a bit to the appropriate piece bitboard
-                if (token == piece_tokens[i]) set_bit(pieces[i], square_index);
+                if (token == piece_tokens[i])
+                {
+                    set_bit(pieces[i], square_index);
+                    piece_on[square_index] = i;
+                }
             }
 
             // Increment the file variable by 1
@@ -186,6 +309,35 @@ void Board::SetFEN(string fen_string){
     occupancies[white] = pieces[P] | pieces[N] | pieces[B] | pieces[R] | pieces[Q] | pieces[K];
     occupancies[black] = pieces[p] | pieces[n] | pieces[b] | pieces[r] | pieces[q] | pieces[k];
     occupancies[both] = occupancies[white] | occupancies[black];
+
+    // hash the new position
+    hash_key = GenerateHashKey();
+}
+
+
+/* Computes the Zobrist key of the current position from scratch. MakeMove keeps hash_key up to date incrementally,
+this is only needed when a position is set up */
+U64 Board::GenerateHashKey()
+{
+    U64 key = 0ULL;
+
+    // every piece on its square
+    for (int square = 0; square < 64; square++)
+        if (piece_on[square] != no_piece)
+            key ^= zobrist_keys.piece_keys[piece_on[square]][square];
+
+    // en passant square, if there is one
+    if (enpassant != no_sq)
+        key ^= zobrist_keys.enpassant_keys[enpassant];
+
+    // castling rights
+    key ^= zobrist_keys.castle_keys[castling_rights];
+
+    // side to move
+    if (turn_to_move == black)
+        key ^= zobrist_keys.side_key;
+
+    return key;
 }
 
 
@@ -216,15 +368,12 @@ bool Board::MakeMove(string move)
             // if the promoted piece == the character in the move, set the promotion piece
             if (promoted_pieces[piece] == move.substr(4, 1))
             {
-                // if there is a promotion, it will always match the white piece first so break to keep it on white piece
+                // it will always match the white piece first, which is how moves store their promotions
                 promotion = piece;
                 break;
             }
 
         }
-
-        // if the move is white, keep the promoted piece as a white piece, otherwise, add 6 to get to the black piece
-        promotion = (turn_to_move == white) ? promotion : promotion + 6;
     }
     // otherwise set promotion to 0
     else promotion = 0;
@@ -245,8 +394,12 @@ bool Board::MakeMove(string move)
         // if the move matches the given source, target, and promotion, then make the move
         if (get_move_source(move) == source && get_move_target(move) == target && get_move_promoted(move) == promotion)
         {
-            // return the value of make move (1 for legal, 0 for non-legal)
-            return MakeMove(move, all_moves);
+            // make the move, only legal moves are generated so it always succeeds
+            MakeMove(move);
+
+            // game moves are never taken back, so drop the undo record to leave the whole stack for searching
+            undo_count = 0;
+            return true;
         }
 
     }
@@ -259,243 +412,281 @@ bool Board::MakeMove(string move)
 /* Given a square, checks if that square is attacked by a given side (white or black) */
 bool Board::IsSquareAttacked(int square, int side)
 {
-    // attacked by white pawns
-    if((side == white) && (move_calc.pawn_attacks[black][square] & pieces[P])) return true;
+    // the square is attacked if the given side has any attackers on it
+    if (side == white)
+        return AttackersOf<white>(square, occupancies[both]) != 0;
+    else
+        return AttackersOf<black>(square, occupancies[both]) != 0;
+}
 
-    // attacked by black pawns
-    if ((side==black) && (move_calc.pawn_attacks[white][square] & pieces[p])) return true;
 
-    // attacked by knights
-    if (move_calc.knight_attacks[square] & ((side == white) ? pieces[N] : pieces[n])) return true;
+/* Returns a bitboard of every piece of the given side that attacks the given square, with sliders looking through
+the given occupancy rather than the board's. Passing a modified occupancy lets the move generator ask whether a
+square would be attacked after some pieces have moved (e.g. the king stepping away along a checking line) */
+template <Color side>
+U64 Board::AttackersOf(int square, U64 occupancy)
+{
+    // If white, offset will be 0, otherwise 6 to look at the black pieces
+    constexpr int offset = side * 6;
+
+    // sliders of each kind, queens count as both
+    U64 diagonal_sliders = pieces[B + offset] | pieces[Q + offset];
+    U64 straight_sliders = pieces[R + offset] | pieces[Q + offset];
+
+    // pawns attack the square if a pawn of the other color on the square would attack them
+    return (move_calc.pawn_attacks[side ^ 1][square] & pieces[P + offset])
+         | (move_calc.knight_attacks[square] & pieces[N + offset])
+         | (move_calc.king_attacks[square] & pieces[K + offset])
+         | (move_calc.GetBishopAttacks(square, occupancy) & diagonal_sliders)
+         | (move_calc.GetRookAttacks(square, occupancy) & straight_sliders);
+}
 
-    // attacked by bishops
-    if (move_calc.GetBishopAttacks(square, occupancies[both]) & ((side==white) ? pieces[B] : pieces[b])) return true;
-    
-    // attacked by rooks
-    if (move_calc.GetRookAttacks(square, occupancies[both]) & ((side==white) ? pieces[R] : pieces[r])) return true;
 
-    // attacked by queens
-    if (move_calc.GetQueenAttacks(square, occupancies[both]) & ((side==white) ? pieces[Q] : pieces[q])) return true;
+/* Shifts a bitboard of pawns of the given side one rank forward (towards the enemy's back rank) */
+template <Color side>
+static constexpr U64 PawnPush(U64 bitboard)
+{
+    return (side == white) ? (bitboard << 8) : (bitboard >> 8);
+}
 
-    // attacked by king
-    if (move_calc.king_attacks[square] & ((side == white) ? pieces[K] : pieces[k])) return true;
 
-    // If not attacked by anything, return false
-    return false;
+/* Returns the pieces of the given side pinned to their king: those that are the only piece between the king and an
+enemy slider looking at it along that line */
+template <Color side>
+U64 Board::PinnedPieces(int king_square)
+{
+    // the other side and the offset of its pieces
+    constexpr Color enemy = Color(side ^ 1);
+    constexpr int enemy_offset = enemy * 6;
+
+    // Enemy sliders that would attack the king if only enemy pieces were on the board
+    U64 snipers = (move_calc.GetBishopAttacks(king_square, occupancies[enemy]) & (pieces[B + enemy_offset] | pieces[Q + enemy_offset]))
+                | (move_calc.GetRookAttacks(king_square, occupancies[enemy]) & (pieces[R + enemy_offset] | pieces[Q + enemy_offset]));
+
+    // A friendly piece that is the only thing between a sniper and the king is pinned
+    U64 pinned = 0ULL;
+    while (snipers)
+    {
+        int sniper_square = BitScan(snipers);
+        U64 blockers = move_calc.between_squares[king_square][sniper_square] & occupancies[both];
+
+        if (count_bits(blockers) == 1)
+            pinned |= blockers & occupancies[side];
+
+        pop_bit(snipers, sniper_square);
+    }
+
+    return pinned;
 }
 
 
-/* Generates a list of pseudo-legal moves */
-void Board::GenerateMoves(MoveList *move_list)
+/* Generates the legal moves of one kind of piece (knight, bishop, rook or queen), moving onto target_mask. Pinned
+pieces stay on the line through their king, which for a pinned knight means it can't move at all */
+template <Color side, int piece>
+void Board::GeneratePieceMoves(MoveList *move_list, U64 source_mask, U64 target_mask, U64 pinned, int king_square)
 {
     // Init the source square and target of any move
     int source_square, target_square;
 
-    // Initializes the enemy color
-    int enemy = turn_to_move ^ 1;
+    // the pieces that may move, a knight can never stay on its pin line
+    U64 bitboard = pieces[piece + side * 6] & source_mask;
+    if (piece == N)
+        bitboard &= ~pinned;
 
-    // If white, offset will be 0, (P + 0 = P), otherwise offset will be 6 (P + 6 = p) to denote white/black pieces
-    int offset = turn_to_move * 6;
+    while(bitboard)
+    {
+        // get source square
+        source_square = BitScan(bitboard);
 
-    // init a bitboard to hold current piece as well as all of it's attacks
-    U64 bitboard, attacks;
+        // attacks of this kind of piece, picked at compile time
+        U64 attacks;
+        if constexpr (piece == N) attacks = move_calc.knight_attacks[source_square];
+        if constexpr (piece == B) attacks = move_calc.GetBishopAttacks(source_square, occupancies[both]);
+        if constexpr (piece == R) attacks = move_calc.GetRookAttacks(source_square, occupancies[both]);
+        if constexpr (piece == Q) attacks = move_calc.GetQueenAttacks(source_square, occupancies[both]);
+        attacks &= target_mask;
 
-    // declare a move variable to hold moves
-    int move;
+        // a pinned piece may only move along the pin
+        if (get_bit(pinned, source_square))
+            attacks &= move_calc.line_squares[king_square][source_square];
 
+        // Iterate over attacks
+        while(attacks)
+        {   
+            // get target square from bitboard
+            target_square = BitScan(attacks);
 
-    
-    
+            // Construct the move and add it to the list
+            AddMove(move_list, encode_move(source_square, target_square, (get_bit(occupancies[side ^ 1], target_square) ? capture_move : quiet_move)));
+            
+            // pop after move is generated
+            pop_bit(attacks, target_square);
+        }
 
-    /*** Quiet Pawn Moves ***/
-    
+        // pop bit after 
+        pop_bit(bitboard, source_square);
+    }
+}
 
-    // If turn to move is white, generate white pawn piece moves
+
+/* Generates a list of legal moves for the side to move. The checking pieces and the pieces pinned to the king are
+found once up front, and from them a mask of squares the non-king pieces may move to: anywhere when not in check, the
+checker or the squares between it and the king when in check, and nowhere in double check (only the king can move
+then). Pinned pieces are further restricted to the line through their king, and the king only steps onto unattacked
+squares. gen_type picks which kind of moves to generate and only pieces standing on source_mask are moved */
+void Board::GenerateMoves(MoveList *move_list, int gen_type, U64 source_mask)
+{
+    // dispatch once to the generator for the side to move
     if (turn_to_move == white)
-    {
-        bitboard = pieces[P];
+        GenerateMoves<white>(move_list, gen_type, source_mask);
+    else
+        GenerateMoves<black>(move_list, gen_type, source_mask);
+}
 
-        // single push targets will be the white pawn shifted up 8 anded with negation of occupancies (empty squares)
-        U64 white_pawn_single_targets = bitboard << 8 & ~occupancies[both];
+/* The move generator for one side. Everything that depends on the side (pawn directions, promotion and double push
+ranks, castling squares) is a compile-time constant */
+template <Color side>
+void Board::GenerateMoves(MoveList *move_list, int gen_type, U64 source_mask)
+{
+    // Init the source square and target of any move
+    int source_square, target_square;
 
-        // Loop over target squares for white pawns
-        while (white_pawn_single_targets)
-        {
-            // init target square
-            target_square = BitScan(white_pawn_single_targets);
+    // the other side
+    constexpr Color enemy = Color(side ^ 1);
 
-            // source square will be rank below target
-            source_square = target_square - 8;
-            
-            // If target square is in the back row
-            if ((1ULL << target_square) & first_last_ranks)
-            {
+    // If white, offset will be 0, (P + 0 = P), otherwise offset will be 6 (P + 6 = p) to denote white/black pieces
+    constexpr int offset = side * 6;
 
-                // Add all the possible promotions
-                move = encode_move(source_square, target_square, P, N, 0, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, P, R, 0, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, P, B, 0, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, P, Q, 0, 0, 0, 0);
-                AddMove(move_list, move);
-            }
+    // how far a pawn push moves in squares, and the rank a double push lands on
+    constexpr int pawn_push = (side == white) ? 8 : -8;
+    constexpr U64 double_push_rank = (side == white) ? rank4 : rank5;
 
-            // Otherwise print it out with no promotions
-            else 
-            {
-                move = encode_move(source_square, target_square, P, 0, 0, 0, 0, 0);
-                AddMove(move_list, move);
-            }
+    // init a bitboard to hold current piece as well as all of it's attacks
+    U64 bitboard, attacks;
 
-            // pop the bit from the target squares
-            pop_bit(white_pawn_single_targets, target_square);
-        }
+    /*** Checks and pins ***/
 
-        // Double push targets are pawns shifted up 16 that end up on rank 4
-        U64 white_pawn_double_targets = (bitboard << 16) & rank4 & ~(occupancies[both] |(occupancies[both] << 8));
+    // square of the king of the side to move
+    int king_square = BitScan(pieces[K + offset]);
 
-        // Loop over targets
-        while(white_pawn_double_targets)
-        {
-            // Get target square
-            target_square = BitScan(white_pawn_double_targets);
+    // enemy pieces currently giving check
+    U64 checkers = AttackersOf<enemy>(king_square, occupancies[both]);
 
-            // get source square
-            source_square = target_square - 16;
-            move = encode_move(source_square, target_square, P, 0, 0, 1, 0, 0);
-            AddMove(move_list, move);
+    // Squares the non-king pieces may move to. When in check a move has to capture the checker or block it, and with
+    // two checkers no other piece can help
+    U64 check_mask = ~0ULL;
+    if (checkers)
+        check_mask = (count_bits(checkers) > 1) ? 0ULL : (checkers | move_calc.between_squares[king_square][BitScan(checkers)]);
 
-            pop_bit(white_pawn_double_targets, target_square);
-        }
-    }
-    // Otherwise generate black pieces moves
-    else
-    {
-        bitboard = pieces[p];
+    // in double check don't bother looking at anything but the king
+    if (!check_mask)
+        source_mask &= pieces[K + offset];
 
-        // single push targets will be the white pawn shifted up 8 anded with negation of occupancies (empty squares)
-        U64 black_pawn_single_targets = bitboard >> 8 & ~occupancies[both];
+    // pieces that can't leave the line between an enemy slider and the king
+    U64 pinned = PinnedPieces<side>(king_square);
 
-        // Loop over target squares for white pawns
-        while (black_pawn_single_targets)
-        {
-            // init target square
-            target_square = BitScan(black_pawn_single_targets);
+    // Squares pieces may land on for this kind of move: enemy pieces for captures, empty squares for quiets and
+    // either one otherwise
+    U64 type_mask = ~occupancies[side];
+    if (gen_type == only_captures) type_mask = occupancies[enemy];
+    if (gen_type == only_quiets) type_mask = ~occupancies[both];
 
-            // source square will be rank below target
-            source_square = target_square + 8;
-            
-            // If target square is in the back row
-            if ((1ULL << target_square) & first_last_ranks)
-            {
-                // Add all the possible promotions
-                move = encode_move(source_square, target_square, p, n, 0, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, p, r, 0, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, p, b, 0, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, p, q, 0, 0, 0, 0);
-                AddMove(move_list, move);
-            }
+    // Pawn pushes are all quiet except promotions, which are generated along with the captures
+    U64 push_mask = ~0ULL;
+    if (gen_type == only_captures) push_mask = first_last_ranks;
+    if (gen_type == only_quiets) push_mask = ~first_last_ranks;
 
-            // Otherwise print it out with no promotions
-            else 
-            {
-                move = encode_move(source_square, target_square, p, 0, 0, 0, 0, 0);
-                AddMove(move_list, move);
-            }
+    // the squares pieces of the side to move may land on (of the right kind, and resolving any check)
+    U64 target_mask = type_mask & check_mask;
 
-            // pop the bit from the target squares
-            pop_bit(black_pawn_single_targets, target_square);
-        }
+    /*** Quiet Pawn Moves ***/
+    bitboard = pieces[P + offset] & source_mask;
 
-        // Double push targets are pawns shifted up 16 that end up on rank 4
-        U64 black_pawn_double_targets = (bitboard >> 16) & rank5 & ~(occupancies[both] | (occupancies[both] >> 8)) ;
+    // single push targets are the pawns pushed one rank onto empty squares
+    U64 single_targets = PawnPush<side>(bitboard) & ~occupancies[both] & check_mask & push_mask;
 
-        // Loop over targets
-        while(black_pawn_double_targets)
-        {
-            // Get target square
-            target_square = BitScan(black_pawn_double_targets);
+    // Loop over target squares for the pawns
+    while (single_targets)
+    {
+        // init target square
+        target_square = BitScan(single_targets);
+
+        // source square will be one rank behind the target
+        source_square = target_square - pawn_push;
 
-            // get source square
-            source_square = target_square + 16;
-            move = encode_move(source_square, target_square, p, 0, 0, 1, 0, 0);
-            AddMove(move_list, move);
+        // pop the bit from the target squares
+        pop_bit(single_targets, target_square);
 
-            pop_bit(black_pawn_double_targets, target_square);
+        // a pinned pawn may only push along the pin
+        if (get_bit(pinned, source_square) && !get_bit(move_calc.line_squares[king_square][source_square], target_square))
+            continue;
+        
+        // If target square is in the back row
+        if ((1ULL << target_square) & first_last_ranks)
+        {
+            // Add all the possible promotions
+            AddMove(move_list, encode_move(source_square, target_square, knight_promotion));
+            AddMove(move_list, encode_move(source_square, target_square, rook_promotion));
+            AddMove(move_list, encode_move(source_square, target_square, bishop_promotion));
+            AddMove(move_list, encode_move(source_square, target_square, queen_promotion));
         }
+
+        // Otherwise print it out with no promotions
+        else 
+            AddMove(move_list, encode_move(source_square, target_square, quiet_move));
     }
 
-    /*** Castle Moves ***/
-    // Generate white side castling moves
-    if (turn_to_move == white)
+    // Double push targets are pawns pushed twice that end up on the fourth rank (from their side), with both
+    // squares in front of them empty. They are never captures
+    U64 double_targets = PawnPush<side>(PawnPush<side>(bitboard) & ~occupancies[both]) & double_push_rank & ~occupancies[both] & check_mask;
+    if (gen_type == only_captures) double_targets = 0ULL;
+
+    // Loop over targets
+    while(double_targets)
     {
-        // Make sure white can castle king side
-        if (castling_rights & wk)
-        {
-            // Make sure there are no squares blocking the castle
-            if (!get_bit(occupancies[both], f1) && !get_bit(occupancies[both], g1))
-            {
-                // Make sure king does not move through an attacked square (and is not in check already)
-                if (!IsSquareAttacked(e1, black) && !(IsSquareAttacked(f1, black))){
-                    move = encode_move(e1, g1, K, 0, 0, 0, 0, 1);
-                    AddMove(move_list, move);
-                }
-            }
-        }
-        // Make sure white can castle queen side
-        if(castling_rights & wq)
-        {
-             // Make sure there are no squares blocking the castle
-            if (!get_bit(occupancies[both], c1) && !get_bit(occupancies[both], d1) && !get_bit(occupancies[both], b1))
-            {
-                // Make sure king does not move through an attacked square (and is not in check already)
-                if (!IsSquareAttacked(d1, black) && !(IsSquareAttacked(e1, black))){
-                    move = encode_move(e1, c1, K, 0, 0, 0, 0, 1);
-                    AddMove(move_list, move);
-                }
-            }
-        }
+        // Get target square
+        target_square = BitScan(double_targets);
+
+        // get source square
+        source_square = target_square - 2 * pawn_push;
+
+        pop_bit(double_targets, target_square);
+
+        // a pinned pawn may only push along the pin
+        if (get_bit(pinned, source_square) && !get_bit(move_calc.line_squares[king_square][source_square], target_square))
+            continue;
+
+        AddMove(move_list, encode_move(source_square, target_square, double_pawn_push));
     }
 
-    // Generate black side castling moves
-    if (turn_to_move == black)
+    /*** Castle Moves ***/
+    // Castling is a quiet king move and is never legal out of check
+    if (!checkers && (gen_type == all_moves || gen_type == only_quiets) && (source_mask & pieces[K + offset]))
     {
-        // Make sure white can castle king side
-        if (castling_rights & bk)
+        // the castling squares are those of white, moved up to the eighth rank for black
+        constexpr int rank_offset = (side == white) ? 0 : 56;
+        constexpr int king_side_right = (side == white) ? wk : bk;
+        constexpr int queen_side_right = (side == white) ? wq : bq;
+
+        // Make sure the king can castle king side, no pieces are in the way and the king does not move through or
+        // onto an attacked square
+        if ((castling_rights & king_side_right) && !get_bit(occupancies[both], f1 + rank_offset) && !get_bit(occupancies[both], g1 + rank_offset))
         {
-            // Make sure there are no squares blocking the castle
-            if (!get_bit(occupancies[both], f8) && !get_bit(occupancies[both], g8))
-            {
-                // Make sure king does not move through an attacked square (and is not in check already)
-                if (!IsSquareAttacked(e8, white) && !(IsSquareAttacked(f8, white))){
-                    move = encode_move(e8, g8, k, 0, 0, 0, 0, 1);
-                    AddMove(move_list, move);
-                }
-            }
+            if (!AttackersOf<enemy>(f1 + rank_offset, occupancies[both]) && !AttackersOf<enemy>(g1 + rank_offset, occupancies[both]))
+                AddMove(move_list, encode_move(e1 + rank_offset, g1 + rank_offset, king_castle));
         }
-        // Make sure white can castle queen side
-        if(castling_rights & bq)
+
+        // Same for the queen side, where the b file square has to be empty as well
+        if ((castling_rights & queen_side_right) && !get_bit(occupancies[both], b1 + rank_offset) && !get_bit(occupancies[both], c1 + rank_offset) && !get_bit(occupancies[both], d1 + rank_offset))
         {
-             // Make sure there are no squares blocking the castle
-            if (!get_bit(occupancies[both], c8) && !get_bit(occupancies[both], d8) && !get_bit(occupancies[both], b8))
-            {
-                // Make sure king does not move through an attacked square (and is not in check already)
-                if (!IsSquareAttacked(d8, white) && !(IsSquareAttacked(e8, white))){
-                    move = encode_move(e8, c8, k, 0, 0, 0, 0, 1);
-                    AddMove(move_list, move);
-                }
-            }
+            if (!AttackersOf<enemy>(d1 + rank_offset, occupancies[both]) && !AttackersOf<enemy>(c1 + rank_offset, occupancies[both]))
+                AddMove(move_list, encode_move(e1 + rank_offset, c1 + rank_offset, queen_castle));
         }
     }
 
     /*** Pawn attacks ***/
-    // Define which source pawns we are going to use, depending on side
-    bitboard = pieces[P + offset];
+    // Pawn captures (and capture promotions) are never quiet
+    bitboard = (gen_type == only_quiets) ? 0ULL : pieces[P + offset] & source_mask;
 
     // Iterate over the source squares
     while(bitboard)
@@ -503,12 +694,12 @@ void Board::GenerateMoves(MoveList *move_list)
         // retrieve the source square
         source_square = BitScan(bitboard);
 
-        // Retrieve the attacks from the current turn's side that can hit an enemy
-        // Adds the en passant square to the move to indicate that it can move (if enpassant is available)
-        attacks = move_calc.pawn_attacks[turn_to_move][source_square] & occupancies[enemy];
-
-        
+        // Retrieve the attacks from this pawn that can hit an enemy
+        attacks = move_calc.pawn_attacks[side][source_square] & occupancies[enemy] & check_mask;
 
+        // a pinned pawn may only capture the pinning piece
+        if (get_bit(pinned, source_square))
+            attacks &= move_calc.line_squares[king_square][source_square];
 
         // Iterate over the attack target squares
         while(attacks)
@@ -520,24 +711,16 @@ void Board::GenerateMoves(MoveList *move_list)
             if (1ULL << target_square & first_last_ranks)
             {   
                 // Add all the possible promotions
-                move = encode_move(source_square, target_square, (P+offset), (N+offset), 1, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, (P+offset), (R+offset), 1, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, (P+offset), (B+offset), 1, 0, 0, 0);
-                AddMove(move_list, move);
-                move = encode_move(source_square, target_square, (P+offset), (Q+offset), 1, 0, 0, 0);
-                AddMove(move_list, move);
+                AddMove(move_list, encode_move(source_square, target_square, knight_promotion_capture));
+                AddMove(move_list, encode_move(source_square, target_square, rook_promotion_capture));
+                AddMove(move_list, encode_move(source_square, target_square, bishop_promotion_capture));
+                AddMove(move_list, encode_move(source_square, target_square, queen_promotion_capture));
             }
+
+            // Otherwise print out the capture
             else
-            {
-                
-                // Otherwise print out the capture
-                move = encode_move(source_square, target_square, (P+offset), 0, 1, 0, (target_square == enpassant), 0);
-                AddMove(move_list, move);
-            }
+                AddMove(move_list, encode_move(source_square, target_square, capture_move));
 
-           
             // Pop bit off attacks bitboard
             pop_bit(attacks, target_square);
         }
@@ -546,8 +729,7 @@ void Board::GenerateMoves(MoveList *move_list)
         if (enpassant != no_sq)
         {   
             // generate the square that the pawn can attack
-            U64 enpassant_attacks = move_calc.pawn_attacks[turn_to_move][source_square] & (1ULL << enpassant);
-
+            U64 enpassant_attacks = move_calc.pawn_attacks[side][source_square] & (1ULL << enpassant);
 
             // if there is an en passant attack square
             if (enpassant_attacks)
@@ -555,153 +737,242 @@ void Board::GenerateMoves(MoveList *move_list)
                 // get the target square
                 target_square = BitScan(enpassant_attacks);
 
-                // encode the move and add it to the list
-                move = encode_move(source_square, target_square, (P + offset), 0, 0, 0, 1, 0);
-                AddMove(move_list, move);
+                // the captured pawn sits behind the target square
+                U64 captured_bitboard = 1ULL << (target_square - pawn_push);
+
+                // En passant takes two pieces off one rank at once, which no pin mask describes, so play it out on
+                // the occupancy and check that nothing (other than the captured pawn) then attacks the king
+                U64 occupancy = occupancies[both] ^ (1ULL << source_square) ^ enpassant_attacks ^ captured_bitboard;
+                if (!(AttackersOf<enemy>(king_square, occupancy) & ~captured_bitboard))
+                    AddMove(move_list, encode_move(source_square, target_square, ep_capture));
             }
         }
 
         pop_bit(bitboard, source_square);
+    }
+
+    /**** Knight, Bishop, Rook and Queen Moves ****/
+    GeneratePieceMoves<side, N>(move_list, source_mask, target_mask, pinned, king_square);
+    GeneratePieceMoves<side, B>(move_list, source_mask, target_mask, pinned, king_square);
+    GeneratePieceMoves<side, R>(move_list, source_mask, target_mask, pinned, king_square);
+    GeneratePieceMoves<side, Q>(move_list, source_mask, target_mask, pinned, king_square);
+
+    /**** King Moves ****/
+    source_square = king_square;
+    attacks = (source_mask & pieces[K + offset]) ? (move_calc.king_attacks[source_square] & type_mask) : 0ULL;
 
+    // The king is taken off the board while testing its targets, otherwise it would hide the squares behind it from
+    // a slider that is checking it along that line
+    U64 occupancy_without_king = occupancies[both] ^ (1ULL << king_square);
+
+    // Iterate over attacks
+    while(attacks)
+    {   
+        // get target square from bitboard
+        target_square = BitScan(attacks);
+
+        // the king may only step onto squares the enemy does not attack
+        if (!AttackersOf<enemy>(target_square, occupancy_without_king))
+            AddMove(move_list, encode_move(source_square, target_square, (get_bit(occupancies[enemy], target_square) ? capture_move : quiet_move)));
+        
+        // pop after move is generated
+        pop_bit(attacks, target_square);
     }
+}
 
-    /**** Knight Moves ****/
 
-    // Get the appropriately colored knight bitboard
-    bitboard = pieces[N + offset];
+/* Counts the legal moves of the side to move without generating them. It works out checks and pins the same way as
+GenerateMoves, but counts each piece's targets with a popcount instead of adding them to a list one by one */
+int Board::CountLegalMoves()
+{
+    // dispatch once to the counter for the side to move
+    if (turn_to_move == white)
+        return CountLegalMoves<white>();
+    else
+        return CountLegalMoves<black>();
+}
 
-    while(bitboard)
-    {
-        // get source square and attacks
-        source_square = BitScan(bitboard);
-        attacks = move_calc.knight_attacks[source_square] & ~occupancies[turn_to_move];
+/* The legal move counter for one side. Only the king's targets, en passant and castling are tested one at a time,
+everything else is counted in bulk. A promotion counts as four moves, one per piece it can promote to */
+template <Color side>
+int Board::CountLegalMoves()
+{
+    // the other side
+    constexpr Color enemy = Color(side ^ 1);
 
-        // Iterate over attacks
-        while(attacks)
-        {   
-            // get target square from bitboard
-            target_square = BitScan(attacks);
+    // If white, offset will be 0, otherwise 6 for the black pieces
+    constexpr int offset = side * 6;
 
-            // Construct the move and add it to the list
-            move = encode_move(source_square, target_square, (N + offset), 0, (get_bit(occupancies[enemy], target_square) ? 1 : 0), 0, 0, 0);
-            AddMove(move_list, move);
-            
-            // pop after move is generated
-            pop_bit(attacks, target_square);
-        }
+    // how far a pawn push moves in squares, and the rank a double push lands on
+    constexpr int pawn_push = (side == white) ? 8 : -8;
+    constexpr U64 double_push_rank = (side == white) ? rank4 : rank5;
 
-        // pop bit after 
-        pop_bit(bitboard, source_square);
+    // number of legal moves found so far
+    int count = 0;
+
+    /*** Checks and pins, as in GenerateMoves ***/
+    int king_square = BitScan(pieces[K + offset]);
+    U64 checkers = AttackersOf<enemy>(king_square, occupancies[both]);
+
+    // squares the non-king pieces may move to, nowhere in double check
+    U64 check_mask = ~0ULL;
+    if (checkers)
+        check_mask = (count_bits(checkers) > 1) ? 0ULL : (checkers | move_calc.between_squares[king_square][BitScan(checkers)]);
+
+    U64 pinned = PinnedPieces<side>(king_square);
+    U64 empty = ~occupancies[both];
+
+    /*** King Moves ***/
+    // every target has to be tested, with the king off the board so it doesn't hide squares behind it
+    U64 attacks = move_calc.king_attacks[king_square] & ~occupancies[side];
+    U64 occupancy_without_king = occupancies[both] ^ (1ULL << king_square);
+    while (attacks)
+    {
+        int target_square = BitScan(attacks);
+        if (!AttackersOf<enemy>(target_square, occupancy_without_king))
+            count++;
+        pop_bit(attacks, target_square);
     }
 
-    /**** Bishop Moves ****/
-    bitboard = (turn_to_move == white) ? pieces[B] : pieces[b];
+    // in double check only the king can move
+    if (!check_mask)
+        return count;
 
-    while(bitboard)
+    /*** Castle Moves ***/
+    if (!checkers)
     {
-        // get source square and attacks
-        source_square = BitScan(bitboard);
-        attacks = move_calc.GetBishopAttacks(source_square, occupancies[both]) & ~occupancies[turn_to_move];
+        constexpr int rank_offset = (side == white) ? 0 : 56;
+        constexpr int king_side_right = (side == white) ? wk : bk;
+        constexpr int queen_side_right = (side == white) ? wq : bq;
 
-        // Iterate over attacks
-        while(attacks)
-        {   
-            // get target square from bitboard
-            target_square = BitScan(attacks);
+        if ((castling_rights & king_side_right) && !get_bit(occupancies[both], f1 + rank_offset) && !get_bit(occupancies[both], g1 + rank_offset))
+        {
+            if (!AttackersOf<enemy>(f1 + rank_offset, occupancies[both]) && !AttackersOf<enemy>(g1 + rank_offset, occupancies[both]))
+                count++;
+        }
 
-            // Construct the move and add it to the list
-            move = encode_move(source_square, target_square, (B + offset), 0, (get_bit(occupancies[enemy], target_square) ? 1 : 0), 0, 0, 0);
-            AddMove(move_list, move);
-            
-            // pop after move is generated
-            pop_bit(attacks, target_square);
+        if ((castling_rights & queen_side_right) && !get_bit(occupancies[both], b1 + rank_offset) && !get_bit(occupancies[both], c1 + rank_offset) && !get_bit(occupancies[both], d1 + rank_offset))
+        {
+            if (!AttackersOf<enemy>(d1 + rank_offset, occupancies[both]) && !AttackersOf<enemy>(c1 + rank_offset, occupancies[both]))
+                count++;
         }
+    }
+
+    /*** Pawn Moves ***/
+    // Pushes of unpinned pawns are counted for all of them at once, promotions four times over
+    U64 free_pawns = pieces[P + offset] & ~pinned;
+    U64 single_targets = PawnPush<side>(free_pawns) & empty;
+    U64 double_targets = PawnPush<side>(single_targets) & double_push_rank & empty & check_mask;
+    single_targets &= check_mask;
+    count += count_bits(single_targets & ~first_last_ranks) + 4 * count_bits(single_targets & first_last_ranks) + count_bits(double_targets);
+
+    // pinned pawns may only push along the pin
+    U64 bitboard = pieces[P + offset] & pinned;
+    while (bitboard)
+    {
+        int source_square = BitScan(bitboard);
+        U64 line = move_calc.line_squares[king_square][source_square];
+
+        U64 single_target = PawnPush<side>(1ULL << source_square) & empty;
+        U64 double_target = PawnPush<side>(single_target) & double_push_rank & empty & check_mask & line;
+        single_target &= check_mask & line;
+        count += count_bits(single_target & ~first_last_ranks) + 4 * count_bits(single_target & first_last_ranks) + count_bits(double_target);
 
-        // pop bit after 
         pop_bit(bitboard, source_square);
     }
 
-    /**** Rook Moves ****/
-    bitboard = (turn_to_move == white) ? pieces[R] : pieces[r];
-
-    while(bitboard)
+    // captures, a pinned pawn may only capture the pinning piece
+    bitboard = pieces[P + offset];
+    while (bitboard)
     {
-        // get source square and attacks
-        source_square = BitScan(bitboard);
-        attacks = move_calc.GetRookAttacks(source_square, occupancies[both]) & ~occupancies[turn_to_move];
+        int source_square = BitScan(bitboard);
 
-        // Iterate over attacks
-        while(attacks)
-        {   
-            // get target square from bitboard
-            target_square = BitScan(attacks);
-
-            // Construct the move and add it to the list
-            move = encode_move(source_square, target_square, (R + offset), 0, (get_bit(occupancies[enemy], target_square) ? 1 : 0), 0, 0, 0);
-            AddMove(move_list, move);
-            
-            // pop after move is generated
-            pop_bit(attacks, target_square);
-        }
+        attacks = move_calc.pawn_attacks[side][source_square] & occupancies[enemy] & check_mask;
+        if (get_bit(pinned, source_square))
+            attacks &= move_calc.line_squares[king_square][source_square];
+        count += count_bits(attacks & ~first_last_ranks) + 4 * count_bits(attacks & first_last_ranks);
 
-        // pop bit after 
         pop_bit(bitboard, source_square);
     }
 
-    /**** Queen Moves ****/
-    bitboard = (turn_to_move == white) ? pieces[Q] : pieces[q];
-
-    while(bitboard)
+    // en passant is played out on the occupancy as in GenerateMoves, for each of the (at most two) pawns that can take
+    if (enpassant != no_sq)
     {
-        // get source square and attacks
-        source_square = BitScan(bitboard);
-        attacks = move_calc.GetQueenAttacks(source_square, occupancies[both]) & ~occupancies[turn_to_move];
+        U64 captured_bitboard = 1ULL << (enpassant - pawn_push);
 
-        // Iterate over attacks
-        while(attacks)
-        {   
-            // get target square from bitboard
-            target_square = BitScan(attacks);
+        bitboard = move_calc.pawn_attacks[enemy][enpassant] & pieces[P + offset];
+        while (bitboard)
+        {
+            int source_square = BitScan(bitboard);
 
-            // Construct the move and add it to the list
-            move = encode_move(source_square, target_square, (Q + offset), 0, (get_bit(occupancies[enemy], target_square) ? 1 : 0), 0, 0, 0);
-            AddMove(move_list, move);
-            
-            // pop after move is generated
-            pop_bit(attacks, target_square);
-        }
+            U64 occupancy = occupancies[both] ^ (1ULL << source_square) ^ (1ULL << enpassant) ^ captured_bitboard;
+            if (!(AttackersOf<enemy>(king_square, occupancy) & ~captured_bitboard))
+                count++;
 
-        // pop bit after 
-        pop_bit(bitboard, source_square);
+            pop_bit(bitboard, source_square);
+        }
     }
 
-    /**** King Moves ****/
-    bitboard = (turn_to_move == white) ? pieces[K] : pieces[k];
+    /**** Knight, Bishop, Rook and Queen Moves ****/
+    U64 target_mask = ~occupancies[side] & check_mask;
 
-    while(bitboard)
+    // pinned knights can never move
+    bitboard = pieces[N + offset] & ~pinned;
+    while (bitboard)
     {
-        // get source square and attacks
-        source_square = BitScan(bitboard);
-        attacks = move_calc.king_attacks[source_square] & ~occupancies[turn_to_move];
+        int source_square = BitScan(bitboard);
+        count += count_bits(move_calc.knight_attacks[source_square] & target_mask);
+        pop_bit(bitboard, source_square);
+    }
 
-        // Iterate over attacks
-        while(attacks)
-        {   
-            // get target square from bitboard
-            target_square = BitScan(attacks);
+    // sliders, staying on the line through the king when pinned
+    U64 diagonal_sliders = pieces[B + offset] | pieces[Q + offset];
+    U64 straight_sliders = pieces[R + offset] | pieces[Q + offset];
 
-            // Construct the move and add it to the list
-            move = encode_move(source_square, target_square, (K + offset), 0, (get_bit(occupancies[enemy], target_square) ? 1 : 0), 0, 0, 0);
-            AddMove(move_list, move);
-            
-            // pop after move is generated
-            pop_bit(attacks, target_square);
-        }
+    bitboard = diagonal_sliders;
+    while (bitboard)
+    {
+        int source_square = BitScan(bitboard);
+        attacks = move_calc.GetBishopAttacks(source_square, occupancies[both]) & target_mask;
+        if (get_bit(pinned, source_square))
+            attacks &= move_calc.line_squares[king_square][source_square];
+        count += count_bits(attacks);
+        pop_bit(bitboard, source_square);
+    }
 
-        // pop bit after 
+    bitboard = straight_sliders;
+    while (bitboard)
+    {
+        int source_square = BitScan(bitboard);
+        attacks = move_calc.GetRookAttacks(source_square, occupancies[both]) & target_mask;
+        if (get_bit(pinned, source_square))
+            attacks &= move_calc.line_squares[king_square][source_square];
+        count += count_bits(attacks);
         pop_bit(bitboard, source_square);
     }
 
+    return count;
+}
+
+
+/* Checks a move that didn't come from generating this position's moves (a hash or killer move) by generating the
+legal moves of the piece on its source square and looking for it among them */
+bool Board::IsLegalMove(int move)
+{
+    // no move at all
+    if (!move)
+        return false;
+
+    // the legal moves of whatever is on the source square
+    MoveList move_list;
+    GenerateMoves(&move_list, all_moves, 1ULL << get_move_source(move));
+
+    // the move is legal if it is one of them (the encoding also covers the piece and its flags)
+    for (int legal_move : move_list)
+        if (legal_move == move)
+            return true;
+
+    return false;
 }
 
 
@@ -717,343 +988,779 @@ void Board::AddMove(MoveList *move_list, int move){
 }
 
 
-int Board::MakeMove(int move, int move_flag)
+/* Makes a move on the board by updating only the bitboards it touches. The state the move overwrites (captured
+piece, en passant square and castling rights) is pushed onto the undo stack so that UnmakeMove can restore it.
+The move must be legal, either straight from GenerateMoves or checked with IsLegalMove */
+void Board::MakeMove(int move)
 {
+    // dispatch once to the version for the side to move
+    if (turn_to_move == white)
+        MakeMove<white>(move);
+    else
+        MakeMove<black>(move);
+}
 
-    
+/* MakeMove for one side, with the side's pieces, pawn direction and castling squares known at compile time */
+template <Color side>
+void Board::MakeMove(int move)
+{
     // Used for looking at the correct side
-    int offset = (turn_to_move) * 6;
-    int enemy_offset = (turn_to_move ^ 1) * 6;
+    constexpr int offset = side * 6;
+    constexpr int enemy_offset = (side ^ 1) * 6;
+    constexpr Color enemy = Color(side ^ 1);
+
+    // how far a pawn push moves in squares
+    constexpr int pawn_push = (side == white) ? 8 : -8;
+
+    // parse move, the moving piece is whatever stands on the source square
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int piece = piece_on[source_square];
+    int promoted = get_move_promoted(move);
+    int double_push = get_move_double(move);
+    int enpass = get_move_enpassant(move);
+    int castling = get_move_castling(move);
+
+    // save the parts of the board state that this move is about to overwrite
+    UndoInfo &undo = undo_stack[undo_count++];
+    undo.captured_piece = no_piece;
+    undo.enpassant = enpassant;
+    undo.castling_rights = castling_rights;
+    undo.hash_key = hash_key;
+
+    // take the old en passant square and castling rights out of the hash key, and switch the side to move
+    if (enpassant != no_sq) hash_key ^= zobrist_keys.enpassant_keys[enpassant];
+    hash_key ^= zobrist_keys.castle_keys[castling_rights] ^ zobrist_keys.side_key;
+
+    // bitboards of the target square and of both squares the piece moves between
+    U64 target_bitboard = 1ULL << target_square;
+    U64 source_target = (1ULL << source_square) | target_bitboard;
+
+    // handle capture moves (en passant targets an empty square and is handled below)
+    int captured_piece = piece_on[target_square];
+    if (captured_piece != no_piece)
+    {
+        // remove the captured piece and remember it for unmaking
+        pieces[captured_piece] ^= target_bitboard;
+        occupancies[enemy] ^= target_bitboard;
+        hash_key ^= zobrist_keys.piece_keys[captured_piece][target_square];
+        undo.captured_piece = captured_piece;
+    }
+
+    // move piece
+    pieces[piece] ^= source_target;
+    occupancies[side] ^= source_target;
+    piece_on[source_square] = no_piece;
+    piece_on[target_square] = piece;
+    hash_key ^= zobrist_keys.piece_keys[piece][source_square] ^ zobrist_keys.piece_keys[piece][target_square];
+
+    // Handle promotions
+    if (promoted)
+    {   
+        // swap the pawn on the last rank for the promoted piece (of the moving side's color)
+        pieces[P + offset] ^= target_bitboard;
+        pieces[promoted + offset] ^= target_bitboard;
+        piece_on[target_square] = promoted + offset;
+        hash_key ^= zobrist_keys.piece_keys[P + offset][target_square] ^ zobrist_keys.piece_keys[promoted + offset][target_square];
+    }
 
-    // quiet moves
-    if (move_flag == all_moves)
+    // Handle en passant moves
+    if (enpass)
     {
+        // The captured pawn sits behind the target square (from the moving side's point of view)
+        int captured_square = target_square - pawn_push;
+        U64 captured_bitboard = 1ULL << captured_square;
+        pieces[P + enemy_offset] ^= captured_bitboard;
+        occupancies[enemy] ^= captured_bitboard;
+        piece_on[captured_square] = no_piece;
+        hash_key ^= zobrist_keys.piece_keys[P + enemy_offset][captured_square];
+    }
 
-        // preserve board state in case we have to take it back
-        copy_board();
-
-        // parse move
-        int source_square = get_move_source(move);
-        int target_square = get_move_target(move);
-        int piece = get_move_piece(move);
-        int promoted = get_move_promoted(move);
-        int capture = get_move_capture(move);
-        int double_push = get_move_double(move);
-        int enpass = get_move_enpassant(move);
-        int castling = get_move_castling(move);
-
-        // move piece
-        pop_bit(pieces[piece], source_square);
-        set_bit(pieces[piece], target_square);
-
-        // handle capture moves
-        if (capture)
-        {
-            
+    // Always reset en passant square before checking for double pushes and after checking for en passant captures
+    enpassant = no_sq;
 
-            // pick up bitboard piece index ranges depending on side
-            int start_piece = P + enemy_offset;
-            int end_piece = K + enemy_offset;
+    // Handle double pushes
+    if (double_push)
+    {   
+        // If a pawn has a double move, then set the en passant square
+        enpassant = target_square - pawn_push;
+        hash_key ^= zobrist_keys.enpassant_keys[enpassant];
+    }
 
-            // loop over all of the enemy pieces to see which one is being captures
-            for (int bb_piece = start_piece; bb_piece <= end_piece; bb_piece++)
-            {
-                // if there is a piece on the target square
-                if (get_bit(pieces[bb_piece], target_square))
-                {
-                    // then remove it and stop looking for pieces   
-                    pop_bit(pieces[bb_piece], target_square);
-                    break;
-                }
-            }
-        }
+    // Handle castle moves
+    if (castling)
+    {
+        // squares the rook moves between, the H rook castling king side and the A rook queen side
+        constexpr int rank_offset = (side == white) ? 0 : 56;
+        int rook_source = (get_move_flag(move) == king_castle) ? (h1 + rank_offset) : (a1 + rank_offset);
+        int rook_target = (get_move_flag(move) == king_castle) ? (f1 + rank_offset) : (d1 + rank_offset);
+
+        U64 rook_squares = (1ULL << rook_source) | (1ULL << rook_target);
+        pieces[R + offset] ^= rook_squares;
+        occupancies[side] ^= rook_squares;
+        piece_on[rook_source] = no_piece;
+        piece_on[rook_target] = R + offset;
+        hash_key ^= zobrist_keys.piece_keys[R + offset][rook_source] ^ zobrist_keys.piece_keys[R + offset][rook_target];
+    }
 
-        // Handle promotions
-        if (promoted)
-        {   
-            // remove the enemy pawn from the last rank
-            pop_bit(pieces[P + offset], target_square);
+    // update castling rights if either a rook or the king moves or a rook is captured
+    castling_rights &= board_castling_rights[source_square];
+    castling_rights &= board_castling_rights[target_square];
+    hash_key ^= zobrist_keys.castle_keys[castling_rights];
 
-            // initialize a new promoted piece on that square
-            set_bit(pieces[promoted], target_square);
-        }
+    // Both sides' occupancies are up to date, combine them
+    occupancies[both] = occupancies[white] | occupancies[black];
 
-        
+    // Toggle the current side
+    turn_to_move = enemy;
 
-        // Handle en passant moves
-        if (enpass)
-        {
-            // If white's turn, remove black pawn at the appropriate spot, otherwise remove white pawn
-            (turn_to_move == white) ? (pop_bit(pieces[p], (target_square - 8))) : (pop_bit(pieces[P], (target_square + 8)));
+}
 
-        }
+/* Takes back the last move made on the board. Every bitboard change in MakeMove was an XOR, so applying the same
+XORs again reverts them, and the rest of the state comes back from the move's undo record */
+void Board::UnmakeMove(int move)
+{
+    // dispatch to the version for the side that made the move
+    if (turn_to_move == white)
+        UnmakeMove<black>(move);
+    else
+        UnmakeMove<white>(move);
+}
 
-        // Always reset en passant square before checking for double pushes and after checking for en passant captures
-        enpassant = no_sq;
+/* UnmakeMove for the side that made the move */
+template <Color side>
+void Board::UnmakeMove(int move)
+{
+    // Switch back to the side that made the move
+    turn_to_move = side;
 
-        // Handle double pushes
-        if (double_push)
-        {   
-            // If a pawn has a double move, then set the en passant square
-            enpassant = (turn_to_move == white) ? (target_square - 8) : (target_square + 8);
-        }
+    // Used for looking at the correct side
+    constexpr int offset = side * 6;
+    constexpr int enemy_offset = (side ^ 1) * 6;
+    constexpr Color enemy = Color(side ^ 1);
 
-        // Handle castle moves
-        if (castling)
-        {
-            switch(target_square)
-            {
-                case (g1):
-                    // Move H rook
-                    pop_bit(pieces[R], h1);
-                    set_bit(pieces[R], f1);
-                    break;
-
-                case (c1):
-                    // Move A rook
-                    pop_bit(pieces[R], a1);
-                    set_bit(pieces[R], d1);   
-                    break;
-
-                case (g8):
-                    // Move H rook
-                    pop_bit(pieces[r], h8);
-                    set_bit(pieces[r], f8);
-                    break;
-                
-                case (c8):
-                    // Move A Rook
-                    pop_bit(pieces[r], a8);
-                    set_bit(pieces[r], d8);
-                    break;
-            }
-        }
+    // how far a pawn push moves in squares
+    constexpr int pawn_push = (side == white) ? 8 : -8;
 
-        // update castling rights if either a rook or the king moves or a rook is captured
-        castling_rights &= board_castling_rights[source_square];
-        castling_rights &= board_castling_rights[target_square];
+    // pop the undo record of this move
+    const UndoInfo &undo = undo_stack[--undo_count];
 
-        // Re-initialize the occupancies bitboards after a move has been made
-        occupancies[white] = pieces[P] | pieces[N] | pieces[R] | pieces[B] | pieces[Q] | pieces[K];
-        occupancies[black] = pieces[p] | pieces[n] | pieces[r] | pieces[b] | pieces[q] | pieces[k];
-        occupancies[both] = occupancies[white] | occupancies[black];
+    // parse move, the moved piece now stands on the target square (a promotion was made by a pawn)
+    int source_square = get_move_source(move);
+    int target_square = get_move_target(move);
+    int promoted = get_move_promoted(move);
+    int piece = promoted ? (P + offset) : piece_on[target_square];
 
-        // Toggle the current side
-        turn_to_move ^= 1;
+    U64 target_bitboard = 1ULL << target_square;
+    U64 source_target = (1ULL << source_square) | target_bitboard;
 
-        // If the king of the last color is under attack, this is an illegal move
-        if (IsSquareAttacked((turn_to_move == white) ? BitScan(pieces[k]) : BitScan(pieces[K]), turn_to_move))
-        {
-            // Take it back and return 0 for illegal move
-            take_back();
-            return 0;
-        }
-        else
-            // return 1 for legal move
-            return 1;
+    // put the castled rook back in the corner
+    if (get_move_castling(move))
+    {
+        constexpr int rank_offset = (side == white) ? 0 : 56;
+        int rook_source = (get_move_flag(move) == king_castle) ? (h1 + rank_offset) : (a1 + rank_offset);
+        int rook_target = (get_move_flag(move) == king_castle) ? (f1 + rank_offset) : (d1 + rank_offset);
+
+        U64 rook_squares = (1ULL << rook_source) | (1ULL << rook_target);
+        pieces[R + offset] ^= rook_squares;
+        occupancies[side] ^= rook_squares;
+        piece_on[rook_target] = no_piece;
+        piece_on[rook_source] = R + offset;
+    }
 
+    // put back the pawn taken en passant
+    if (get_move_enpassant(move))
+    {
+        int captured_square = target_square - pawn_push;
+        U64 captured_bitboard = 1ULL << captured_square;
+        pieces[P + enemy_offset] ^= captured_bitboard;
+        occupancies[enemy] ^= captured_bitboard;
+        piece_on[captured_square] = P + enemy_offset;
     }
 
-    // capture moves
-    else
+    // turn the promoted piece back into a pawn
+    if (promoted)
     {
-        // If it is a capture move, make it
-        if (get_move_capture(move))
-            return MakeMove(move, all_moves);
+        pieces[promoted + offset] ^= target_bitboard;
+        pieces[P + offset] ^= target_bitboard;
+    }
 
-        // otherwise return 0
-        else
-            return 0;
+    // move the piece back to its source square
+    pieces[piece] ^= source_target;
+    occupancies[side] ^= source_target;
+    piece_on[source_square] = piece;
+
+    // restore a captured piece (or leave the target square empty)
+    piece_on[target_square] = undo.captured_piece;
+    if (undo.captured_piece != no_piece)
+    {
+        pieces[undo.captured_piece] ^= target_bitboard;
+        occupancies[enemy] ^= target_bitboard;
     }
+
+    occupancies[both] = occupancies[white] | occupancies[black];
+
+    // restore the state that can't be worked out from the move
+    enpassant = undo.enpassant;
+    castling_rights = undo.castling_rights;
+    hash_key = undo.hash_key;
+}
+
+/* Passes the turn without moving anything, for null move pruning. The en passant square goes (it was only there for
+the side passing), and like a real move the old state is pushed onto the undo stack */
+void Board::MakeNullMove()
+{
+    // save what the null move changes
+    UndoInfo &undo = undo_stack[undo_count++];
+    undo.captured_piece = no_piece;
+    undo.enpassant = enpassant;
+    undo.castling_rights = castling_rights;
+    undo.hash_key = hash_key;
+
+    // remove the en passant square and hand the move over, from the key as well
+    if (enpassant != no_sq)
+        hash_key ^= zobrist_keys.enpassant_keys[enpassant];
+    enpassant = no_sq;
+
+    turn_to_move ^= 1;
+    hash_key ^= zobrist_keys.side_key;
+}
+
+/* Takes back a null move */
+void Board::UnmakeNullMove()
+{
+    UndoInfo &undo = undo_stack[--undo_count];
+
+    enpassant = undo.enpassant;
+    hash_key = undo.hash_key;
+    turn_to_move ^= 1;
 }
 
 /* Performance test driver, calls the recursive perft function to generate all moves to a given depth
 and record the time taken to generate those moves */
-void Board::perft_driver(int depth){
+void Board::perft_driver(int depth, int threads, PerftTable *table){
     
-    // initialize a clock to keep track of the time it takes to search
-    clock_t time_elapsed;
+    // perft is timed on the wall clock, CPU time would add up the time of every thread
+    auto start = chrono::steady_clock::now();
 
-    // get the starting time
-    time_elapsed = clock();
+    // count with the caller's hash table, if there is one
+    perft_table = table;
+    perft_probes = perft_hits = perft_leaves = 0;
 
     // init the list of moves
     MoveList moves;
 
-    // init num of nodes searched
-    int nodes = 0;
-
-    // init number of nodes searched for every move
-    int move_nodes;
-
     // generate all moves for this board state
     GenerateMoves(&moves);
 
+    // number of nodes under every root move
+    vector<U64> move_nodes = PerftDivide(moves, depth, threads);
+
+    // init num of nodes searched
+    U64 nodes = 0;
+
     // iterate over every move
     for (int i = 0; i < moves.count; i++){
 
-        // grab the move from the MoveList object
-        int move = moves.moves[i];
+        // grab the move from the MoveList object
+        int move = moves.moves[i];
+
+        // print out the move and it's nodes for perft divide debugging purposes
+        cout << square_index[get_move_source(move)] << square_index[get_move_target(move)] <<
+            promoted_pieces[get_move_promoted(move)] << ": " << move_nodes[i] << endl;
+
+        // increment total nodes
+        nodes += move_nodes[i];
+    }
+
+    // get the elapsed time
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double mil_nodes_per_second = nodes / seconds / 1000000;
+
+    cout << "nodes searched: " << nodes  << endl;
+    cout << "total time: " << seconds <<  " seconds" << endl;
+    cout << mil_nodes_per_second << " million nodes per second" << endl;
+
+    // with the hash table, show how often it hit and how much of the tree was actually walked. Without it every
+    // counted node is a leaf perft reached, so nodes / leaves reached is the work the table saved
+    if (perft_table)
+    {
+        cout << "hash hits: " << perft_hits << " of " << perft_probes << " probes (" <<
+            (perft_probes ? 100.0 * perft_hits / perft_probes : 0.0) << "%)" << endl;
+        cout << "leaf nodes reached: " << perft_leaves << " (" <<
+            (perft_leaves ? (double)nodes / perft_leaves : 0.0) << "x fewer than without the hash table)" << endl;
+    }
+
+    // the table is only used during this call
+    perft_table = nullptr;
+
+}
+
+/* Counts the nodes to the given depth without printing anything, for the perft suite */
+U64 Board::PerftNodes(int depth, int threads, PerftTable *table)
+{
+    // the root is the only node at depth 0
+    if (depth == 0)
+        return 1;
+
+    // count with the caller's hash table, if there is one
+    perft_table = table;
+    perft_probes = perft_hits = perft_leaves = 0;
+
+    // count the nodes under every root move and add them up
+    MoveList moves;
+    GenerateMoves(&moves);
+
+    U64 nodes = 0;
+    for (U64 move_nodes : PerftDivide(moves, depth, threads))
+        nodes += move_nodes;
+
+    // the table is only used during this call
+    perft_table = nullptr;
+
+    return nodes;
+}
+
+/* Counts the nodes under every root move, one after the other with one thread (or when the tree is too shallow to be
+worth splitting), otherwise with a thread pool */
+vector<U64> Board::PerftDivide(MoveList &moves, int depth, int threads)
+{
+    // hand the subtrees out to a thread pool
+    if (threads > 1 && depth >= 3)
+        return ParallelPerft(moves, depth, threads);
+
+    // number of nodes under every root move
+    vector<U64> move_nodes(moves.count, 0);
+
+    for (int i = 0; i < moves.count; i++)
+    {
+        // make the move, every generated move is legal
+        MakeMove(moves.moves[i]);
+
+        // recursively call the perft function for a depth of -1
+        move_nodes[i] = perft(depth - 1);
+
+        // restore the board state
+        UnmakeMove(moves.moves[i]);
+    }
+
+    return move_nodes;
+}
+
+/* Counts the nodes under every root move with a pool of threads. The tree is split one ply below the root: every
+(root move, reply) pair is a task that runs perft on the rest of the depth, so there are a few hundred tasks of
+uneven size for the pool's work stealing to even out. Every worker plays its tasks on its own copy of the board */
+vector<U64> Board::ParallelPerft(MoveList &moves, int depth, int threads)
+{
+    // the tasks add their counts onto their root move's total
+    vector<atomic<U64>> move_nodes(moves.count);
+
+    // one board per worker
+    vector<Board> boards(threads, *this);
+
+    // the tasks to run
+    vector<function<void(int)>> tasks;
+
+    for (int i = 0; i < moves.count; i++)
+    {
+        int move = moves.moves[i];
+
+        // the replies to this root move
+        MakeMove(move);
+        MoveList replies;
+        GenerateMoves(&replies);
+        UnmakeMove(move);
+
+        // one task per reply, playing both moves on the worker's board and counting what is under them
+        for (int reply : replies)
+        {
+            tasks.push_back([&boards, &move_nodes, i, move, reply, depth](int worker) {
+                Board &board = boards[worker];
+                board.MakeMove(move);
+                board.MakeMove(reply);
+                move_nodes[i] += board.perft(depth - 2);
+                board.UnmakeMove(reply);
+                board.UnmakeMove(move);
+            });
+        }
+    }
+
+    // run them all
+    ThreadPool pool(threads);
+    pool.Run(tasks);
+
+    // add the workers' hash table statistics up (the boards all share this board's table)
+    for (Board &board : boards)
+    {
+        perft_probes += board.perft_probes;
+        perft_hits += board.perft_hits;
+        perft_leaves += board.perft_leaves;
+    }
+
+    // hand back the totals (a root move with no replies has no tasks and stays at 0, as it would in perft)
+    vector<U64> totals(moves.count);
+    for (int i = 0; i < moves.count; i++)
+        totals[i] = move_nodes[i];
+
+    return totals;
+}
+
+// Generates a random legal move and returns it
+int Board::GetRandomMove()
+{
+    // init move list
+    MoveList move_list;
+
+    // populate move list with moves
+    GenerateMoves(&move_list);
+
+    // Sets the random number generator to seed with the current system time
+    srand(time(0));
+
+    // get a random index from the moves generated
+    int random_index = rand() % move_list.count;
+
+    // return a random move
+    return move_list.moves[random_index];
+}
+
+// Generates the best possible move searching through a certain depth
+int Board::GetBestMove(int depth)
+{
+    // a search of its own, starting from nothing
+    NewSearch();
+
+    // search the root moves with a full window
+    int score = SearchRoot(depth, -infinity, infinity);
+
+    // if the turn to move is black, negate the score 
+    score = (turn_to_move == white) ? score : score * -1;
+
+    // return the board evaluation score
+    return score;
+}
+
+/* Clears what the last search learned about move ordering and sets up the root moves. Killers, history and the
+previous PV then carry over from one iteration of the search to the next */
+void Board::NewSearch()
+{
+    // reset the num of nodes searched, ply, and best move variables
+    nodes = 0;
+    ply = 0;
+    best_move = 0;
+
+    // clear data structures for search
+    memset(killer_moves, 0, sizeof(killer_moves));
+    memset(history_moves, 0, sizeof(history_moves));
+    memset(counter_moves, 0, sizeof(counter_moves));
+    memset(pv_table, 0, sizeof(pv_table));
+    memset(pv_length, 0, sizeof(pv_length));
+
+    // no cutoffs counted yet
+    beta_cutoffs = 0;
+    first_move_cutoffs = 0;
+
+    // no previous iteration to follow yet
+    last_pv_length = 0;
+    follow_pv = false;
+
+    // every legal move of the position, none searched yet. Until the first iteration has counted their nodes they
+    // go in the usual order, captures by MVV-LVA with the hash move (from an earlier search) in front
+    root_moves.count = 0;
+    GenerateMoves(&root_moves);
+    SortMoves(&root_moves);
+    memset(root_nodes, 0, sizeof(root_nodes));
+
+    HashEntry hash_entry;
+    if (transposition_table.Probe(hash_key, hash_entry))
+    {
+        Move *hash_move = find(root_moves.begin(), root_moves.end(), hash_entry.move);
+        if (hash_move != root_moves.end())
+            rotate(root_moves.begin(), hash_move, hash_move + 1);
+    }
+}
+
+/* Searches every root move within the window and returns the score for the side to move. Scores are fail-soft: if
+every move fails low the score is the best of their upper bounds, and a move failing high returns its own score. The
+first root move is searched with the full window and the others with a null window around alpha, only searched again
+with the full window if one beats alpha. The root moves are searched in the order the previous iteration left them:
+its best move first, which is also where the previous PV is followed from, then the rest by how many nodes their
+subtrees took, since a move that took a lot of effort to refute is the most likely to turn out best. Afterwards the
+root moves are reordered the same way for the next iteration */
+int Board::SearchRoot(int depth, int alpha, int beta)
+{
+    ply = 0;
+    pv_length[0] = 0;
+
+    // determine if the king is in check, which extends the search as in NegaMax
+    bool in_check = IsSquareAttacked((turn_to_move == white) ? BitScan(pieces[K]) : BitScan(pieces[k]), turn_to_move ^ 1);
+    if (in_check) depth++;
+
+    // no legal moves at the root, checkmate or stalemate
+    if (root_moves.count == 0)
+        return in_check ? -mate_value : 0;
+
+    // remember the bound for the table, alpha before any move was tried
+    int original_alpha = alpha;
 
-        // copy the board to restore move later
-        copy_board();
+    // best score found so far, and the index of the root move that scored it (-1 until one raises alpha)
+    int best_score = -infinity;
+    int best_index = -1;
 
-        // make the move. If it is an illegal move, then continue to the next move
-        if(!MakeMove(move, all_moves)){
-            continue;
+    // the first root move is the previous best move, only its subtree follows the previous PV
+    follow_pv = last_pv_length > 0 && root_moves.moves[0] == last_pv[0];
 
+    for (int index = 0; index < root_moves.count; index++)
+    {
+        int move = root_moves.moves[index];
+        U64 nodes_before = nodes;
 
-        }
-            
-        // recursively call the perft function for a depth of -1
-        move_nodes = perft(depth-1);
+        // the later root moves aren't on the previous PV
+        if (index > 0)
+            follow_pv = false;
 
-        // print out the move and it's nodes for perft divide debugging purposes
-        cout << square_index[get_move_source(move)] << square_index[get_move_target(move)] <<
-            promoted_pieces[get_move_promoted(move)] << ": " << move_nodes << endl;
+        // remember the move for the histories of the plies below
+        moved_piece[ply] = piece_on[get_move_source(move)];
+        moved_to[ply] = get_move_target(move);
 
-        // increment total nodes
-        nodes += move_nodes;
+        // make the move, search it and take it back. The first move is the expected PV, the others are only
+        // expected to fail low, which a null window shows for less. One that beats alpha is searched again
+        ply++;
+        MakeMove(move);
 
-        // restore the board state
-        take_back();
+        int score;
+        if (index == 0)
+            score = -NegaMax(-beta, -alpha, depth - 1, pv_node);
+        else
+        {
+            score = -NegaMax(-alpha - 1, -alpha, depth - 1, cut_node);
 
-    }
+            if (score > alpha && score < beta && !Stopped())
+                score = -NegaMax(-beta, -alpha, depth - 1, pv_node);
+        }
 
-    // get the ending time
-    time_elapsed = clock() - time_elapsed;
-    float seconds = (float) time_elapsed / CLOCKS_PER_SEC;
-    float seconds_per_mil_nodes = nodes / 1000000 / seconds;
+        UnmakeMove(move);
+        ply--;
 
-    cout << "nodes searched: " << nodes  << endl;
-    cout << "total time: " << seconds <<  " seconds" << endl;
-    cout << seconds_per_mil_nodes << " million nodes per second" << endl;
+        // the size of this move's subtree orders the next iteration
+        root_nodes[index] = nodes - nodes_before;
 
-}
+        // the score of an interrupted search means nothing
+        if (Stopped())
+            return 0;
 
-// Generates a random legal move and returns it
-int Board::GetRandomMove()
-{
-    // init move list
-    MoveList move_list;
+        // keep the best score, even one that doesn't reach alpha
+        if (score > best_score)
+            best_score = score;
 
-    // populate move list with moves
-    GenerateMoves(&move_list);
+        // a move that reaches beta, or raises alpha, becomes the best move and the start of the PV
+        if (score > alpha)
+        {
+            best_index = index;
+            best_move = move;
 
-    // Sets the random number generator to seed with the current system time
-    srand(time(0));
+            // write PV move and copy the rest of the line from the child
+            pv_table[0][0] = move;
+            for (int next_ply = 1; next_ply < pv_length[1]; next_ply++)
+                pv_table[0][next_ply] = pv_table[1][next_ply];
+            pv_length[0] = max(pv_length[1], 1);
 
-    // get a random index from the moves generated
-    int random_index = rand() % move_list.count;
+            // beta cutoff, the window was too low
+            if (score >= beta)
+            {
+                transposition_table.Store(hash_key, depth, hash_beta, ScoreToTable(score, 0), move);
+                SortRootMoves(best_index);
+                return score;
+            }
 
-    // return a random move
-    return move_list.moves[random_index];
-}
+            // update the alpha value
+            alpha = score;
+        }
+    }
 
-// Generates the best possible move searching through a certain depth
-int Board::GetBestMove(int depth)
-{
+    // a move that raised alpha makes the score exact, otherwise it is an upper bound
+    transposition_table.Store(hash_key, depth, (alpha > original_alpha) ? hash_exact : hash_alpha, ScoreToTable(best_score, 0), best_move);
 
-    // reset the num of nodes searched, ply, and best move variables
-    nodes = 0;
-    ply = 0;
-    best_move = 0;
+    // an exact result's PV is the line for the next iteration to follow
+    if (alpha > original_alpha)
+    {
+        last_pv_length = pv_length[0];
+        memcpy(last_pv, pv_table[0], sizeof(Move) * pv_length[0]);
+    }
 
-    // clear data structures for search
-    memset(killer_moves, 0, sizeof(killer_moves));
-    memset(pv_table, 0, sizeof(pv_table));
-    memset(pv_length, 0, sizeof(pv_length));
+    SortRootMoves(best_index);
+    return best_score;
+}
 
-    // run the negamax function to get an evaluation and set the best move variable
-    int score = NegaMax(-50000, 50000, depth);
+/* Puts the best root move (if there is one) first and the others after it, those with the most nodes under them
+first. The order of moves with equal counts is kept */
+void Board::SortRootMoves(int best_index)
+{
+    // pair every move with its node count, the best move counts as more than any other
+    vector<pair<U64, Move>> ranked(root_moves.count);
+    for (int index = 0; index < root_moves.count; index++)
+        ranked[index] = {(index == best_index) ? ~0ULL : root_nodes[index], root_moves.moves[index]};
 
-    // if the turn to move is black, negate the score 
-    score = (turn_to_move == white) ? score : score * -1;
+    stable_sort(ranked.begin(), ranked.end(), [](const pair<U64, Move> &a, const pair<U64, Move> &b) { return a.first > b.first; });
 
-    // return the board evaluation score
-    return score;
+    for (int index = 0; index < root_moves.count; index++)
+    {
+        root_moves.moves[index] = ranked[index].second;
+        root_nodes[index] = ranked[index].first;
+    }
 }
 
 int Board::Quiescence(int alpha, int beta)
 {   
 
+    // give up straight away once the search is stopped
+    if (Stopped())
+        return 0;
+
     // increment nodes searched
-    nodes++;
+    CountNode();
 
     // evaluate position
     int evaluation = Evaluate();
 
-    // fail-hard beta cautoff
+    // stop at the maximum depth, the undo stack and killer tables only go that deep
+    if (ply > max_ply - 1)
+        return evaluation;
+
+    // any stored result of this position is deep enough for quiescence, use it if its bound settles the node
+    HashEntry hash_entry;
+    int hash_move = 0;
+    if (transposition_table.Probe(hash_key, hash_entry))
+    {
+        int hash_score = ScoreFromTable(hash_entry.score, ply);
+
+        if (hash_entry.flag == hash_exact)
+            return hash_score;
+        if (hash_entry.flag == hash_alpha && hash_score <= alpha)
+            return hash_score;
+        if (hash_entry.flag == hash_beta && hash_score >= beta)
+            return hash_score;
+
+        hash_move = hash_entry.move;
+    }
+
+    // standing pat already reaches beta, the evaluation is a lower bound of the score
     if (evaluation >= beta)
-        return beta;
+        return evaluation;
+
+    // remember the bound for the table, alpha before any move was tried
+    int original_alpha = alpha;
 
-    // found a better move
+    // the side to move doesn't have to capture, so the score is at least the evaluation
+    int best_score = evaluation;
     if (evaluation > alpha)
     {
         alpha = evaluation;
     }
 
 
-    // init move list
-    MoveList move_list;
-
-    // populate move list with moves
-    GenerateMoves(&move_list);
+    // Hands out the captures and promotions only (quiescence never looks at quiet moves), the hash move first if it
+    // is one of them and the rest most valuable victim first
+    MovePicker move_picker(this, hash_move);
 
-    // sort the moves to search best moves first
-    SortMoves(&move_list);
+    // best capture found, stored with the result
+    int best_move = 0;
 
     // iterate over every move
-    for (int count = 0; count < move_list.count; count++)
+    int move;
+    while ((move = move_picker.NextMove()))
     {
-        // copy board state
-        copy_board();
-
         // update the ply
         ply++;
 
-        // if this move is not valid
-        if (!MakeMove(move_list.moves[count], only_captures))
-        {
-            // decrement ply
-            ply--;
-
-            // continue to next move
-            continue;
-        }
-            
+        // make the capture
+        MakeMove(move);
 
         // recursively get score from negamax function
         int score = -Quiescence(-beta, -alpha);
 
         // take the move back and decrement the ply
-        take_back();
+        UnmakeMove(move);
         ply--;
 
-        // fail-hard beta cautoff
+        // the score of an interrupted search means nothing, don't let it near the table
+        if (Stopped())
+            return 0;
+
+        // beta cutoff, the score is at least this capture's
         if (score >= beta)
-            return beta;
+        {
+            transposition_table.Store(hash_key, 0, hash_beta, ScoreToTable(score, ply), move);
+            return score;
+        }
+
+        // keep the best score, even one that doesn't reach alpha
+        if (score > best_score)
+            best_score = score;
 
         // found a better move
         if (score > alpha)
         {
             alpha = score;
+            best_move = move;
         }
 
     }
 
-    // node fails low
-    return alpha;
+    // a capture that raised alpha makes the score exact, otherwise it is an upper bound
+    transposition_table.Store(hash_key, 0, (alpha > original_alpha) ? hash_exact : hash_alpha, ScoreToTable(best_score, ply), best_move);
+
+    // the best score, below alpha if the node fails low
+    return best_score;
+
+}
+
+// Null move pruning and late move reductions are on unless turned off (for testing) with the UCI options
+bool Board::null_move_pruning = true;
+bool Board::late_move_reductions = true;
+
+/* Late move reductions by [depth][move number], growing with the log of both: a move sorted late at a high depth is
+the least likely to matter and is reduced the most */
+static const auto late_move_reduction = []
+{
+    array<array<int, max_moves>, max_ply + 1> reductions{};
+    for (int depth = 1; depth <= max_ply; depth++)
+        for (int move_number = 1; move_number < max_moves; move_number++)
+            reductions[depth][move_number] = (int)(0.75 + log(depth) * log(move_number) / 2.25);
+
+    return reductions;
+}();
 
+/* Counts a node. Looking at the clock costs far more than searching a node, so it is only done every 2048 nodes,
+a small fraction of a millisecond apart */
+void Board::CountNode()
+{
+    nodes++;
+
+    if ((nodes & 2047) == 0 && time_manager && time_manager->HardLimitReached())
+        stop_flag->store(true, std::memory_order_relaxed);
 }
 
-// The negamax (modified minimax) algorithm to search for a move with alpha beta pruning
-int Board::NegaMax(int alpha, int beta, int depth)
+/* Principal variation search, the negamax (modified minimax) algorithm with alpha beta pruning. Only the first move
+is searched with the full window, the rest are expected to be worse and are searched with a null window around alpha,
+which is cheaper and only tells whether a move beats alpha. The few that do are searched again with the full window.
+Scores are fail-soft: a node that fails low returns the best upper bound found and a cutoff returns the move's own
+score, which makes the bounds stored in the transposition table tighter */
+int Board::NegaMax(int alpha, int beta, int depth, int node_type)
 {
 
-    // init PV length
+    // init PV length, before anything returns so the parent never copies a stale line
     pv_length[ply] = ply;
 
+    // stop a ply short of the maximum depth, the PV table and undo stack only go that deep and a move made here
+    // would need the next ply's entries
+    if (ply >= max_ply - 1)
+        return Evaluate();
+
+    // give up straight away once the search is stopped
+    if (Stopped())
+        return 0;
+
 
     // if at the base depth (base case)
     if (depth == 0)
@@ -1062,7 +1769,7 @@ int Board::NegaMax(int alpha, int beta, int depth)
     
 
     // increment num. of nodes searched
-    nodes++;
+    CountNode();
 
     // determine if the king is in check or note
     bool in_check = IsSquareAttacked((turn_to_move == white) ? BitScan(pieces[K]) : BitScan(pieces[k]), turn_to_move ^ 1);
@@ -1070,77 +1777,203 @@ int Board::NegaMax(int alpha, int beta, int depth)
     // increase search depth if the king has been exposed into a check
     if (in_check) depth++;
 
-    // count number of legal moves
-    int legal_moves = 0;
+    // While still on the previous iteration's PV, its move at this ply is searched first
+    int pv_move = 0;
+    if (follow_pv)
+    {
+        if (ply < last_pv_length)
+            pv_move = last_pv[ply];
+        else
+            follow_pv = false;
+    }
 
-    // init move list
-    MoveList move_list;
+    // Look the position up in the transposition table. If it was searched at least this deep and the stored bound
+    // settles this node it is done, otherwise its best move is tried first. The root is always searched, it has to
+    // come up with a move, and so is the previous PV, so that it is searched out again in full
+    HashEntry hash_entry;
+    int hash_move = 0;
+    if (transposition_table.Probe(hash_key, hash_entry))
+    {
+        int hash_score = ScoreFromTable(hash_entry.score, ply);
 
-    // populate move list with moves
-    GenerateMoves(&move_list);
+        if (ply && !follow_pv && hash_entry.depth >= depth)
+        {
+            if (hash_entry.flag == hash_exact)
+                return hash_score;
+            if (hash_entry.flag == hash_alpha && hash_score <= alpha)
+                return hash_score;
+            if (hash_entry.flag == hash_beta && hash_score >= beta)
+                return hash_score;
+        }
+
+        hash_move = hash_entry.move;
+    }
+
+    // Null move pruning: let the opponent move twice in a row. If a search of that, reduced by a few plies, still
+    // fails high the position is so good that a real move would surely fail high too. It doesn't hold when in check,
+    // just after another null move or in a PV node, nor in zugzwang, where passing would be the best move: the side
+    // to move has to have a piece (not just pawns). The static evaluation has to be at beta already, and the further
+    // above it is the more the search is reduced
+    if (null_move_pruning && depth >= 3 && ply && node_type != pv_node && !in_check && !null_move[ply - 1] && abs(beta) < mate_score)
+    {
+        int offset = turn_to_move * 6;
+        bool has_pieces = pieces[N + offset] | pieces[B + offset] | pieces[R + offset] | pieces[Q + offset];
+        int evaluation = has_pieces ? Evaluate() : 0;
+
+        if (has_pieces && evaluation >= beta)
+        {
+            int reduction = 3 + depth / 4 + min(2, (evaluation - beta) / 200);
+
+            null_move[ply] = true;
+            moved_piece[ply] = no_piece;
+            ply++;
+            MakeNullMove();
+            int score = -NegaMax(-beta, -beta + 1, max(0, depth - 1 - reduction), (node_type == cut_node) ? all_node : cut_node);
+            UnmakeNullMove();
+            ply--;
+            null_move[ply] = false;
+
+            if (Stopped())
+                return 0;
+
+            // a mate found after passing isn't proven for the real moves, so only claim beta then
+            if (score >= beta)
+                return (score >= mate_score) ? beta : score;
+        }
+    }
+
+    // remember the bound for the table, alpha before any move was tried
+    int original_alpha = alpha;
+
+    // best score and move found, stored with the result
+    int best_score = -infinity;
+    int best_move = 0;
+
+    // the quiet moves searched without failing high, penalized in the histories if a later one does
+    Move quiets_tried[max_moves];
+    int quiet_count = 0;
 
-    // sort the moves to search in descending order
-    SortMoves(&move_list);
+    // count number of legal moves
+    int legal_moves = 0;
+
+    // Hands out the moves best first (the PV or hash move, if legal, then the rest), only generating the quiet moves
+    // if no capture cuts off
+    MovePicker move_picker(this, pv_move ? pv_move : hash_move, in_check);
 
     // iterate over every move
-    for (int count = 0; count < move_list.count; count++)
+    int move;
+    while ((move = move_picker.NextMove()))
     {
-        // copy board state
-        copy_board();
+        // only the PV move's subtree carries on along the previous PV
+        if (move != pv_move)
+            follow_pv = false;
+
+        // remember the move for the histories of the plies below
+        bool quiet = !get_move_capture(move) && !get_move_promoted(move);
+        moved_piece[ply] = piece_on[get_move_source(move)];
+        moved_to[ply] = get_move_target(move);
 
         // increment ply, meaning we are making a move
         ply++;
 
-        // if this move is not valid
-        if (!MakeMove(move_list.moves[count], all_moves))
+        // make the move, every picked move is legal
+        MakeMove(move);
+
+        // increment number of legal moves
+        legal_moves++;
+
+        // Late move reductions: once the first few moves haven't failed high, the quiet moves sorted after them
+        // (not killers, checks or anything on the PV) are searched to a reduced depth, a ply less in a PV node and
+        // a ply more in a node expected to fail high. Only if one beats alpha anyway is it searched again to the
+        // full depth
+        bool reduce = late_move_reductions && depth >= 3 && legal_moves > 3 && !in_check && !follow_pv
+                   && !get_move_capture(move) && !get_move_promoted(move)
+                   && move != killer_moves[0][ply - 1] && move != killer_moves[1][ply - 1]
+                   && !IsSquareAttacked(BitScan(pieces[K + turn_to_move * 6]), turn_to_move ^ 1);
+
+        int reduction = 0;
+        if (reduce)
         {
+            reduction = late_move_reduction[depth][legal_moves] + (node_type == cut_node) - (node_type == pv_node);
+            reduction = max(0, min(depth - 2, reduction));
+        }
 
-            // decrement ply
-            ply--;
+        // The first move is searched with the full window, in a PV node it is the expected PV. The later moves get
+        // a null window, and one that beats alpha (inside the window, in a PV node) is searched again with the
+        // full window to find its score. Children of PV nodes other than the first are expected to be cut nodes,
+        // children of cut nodes all nodes and the other way round
+        int score;
+        int child_type = (node_type == cut_node) ? all_node : cut_node;
+        if (legal_moves == 1)
+            score = -NegaMax(-beta, -alpha, depth - 1, (node_type == pv_node) ? pv_node : child_type);
+        else
+        {
+            score = -NegaMax(-alpha - 1, -alpha, depth - 1 - reduction, child_type);
 
-            // continue to next move
-            continue;
+            // a reduced move that beats alpha is searched again to the full depth
+            if (reduction > 0 && score > alpha && !Stopped())
+                score = -NegaMax(-alpha - 1, -alpha, depth - 1, child_type);
 
+            // and in a PV node one that beats alpha without reaching beta is searched with the full window
+            if (score > alpha && score < beta && !Stopped())
+                score = -NegaMax(-beta, -alpha, depth - 1, pv_node);
         }
-            
-
-        // increment number of legal moves
-        legal_moves++;
-        
-        // recursively get score from negamax function
-        int score = -NegaMax(-beta, -alpha, depth - 1);
 
         // restore board state
-        take_back();
+        UnmakeMove(move);
 
         // decrement ply after taking move back
         ply--;
 
-        // fail-hard beta cautoff
+        // the score of an interrupted search means nothing, don't let it near the table, PV or killers
+        if (Stopped())
+            return 0;
+
+        // keep the best score, even one that doesn't reach alpha
+        if (score > best_score)
+            best_score = score;
+
+        // beta cutoff, the score is at least this move's
         if (score >= beta)
         {
-            // on quiet moves
-            if (!get_move_capture(move_list.moves[count]))
+            // count the cutoff, the sooner it comes the better the ordering
+            beta_cutoffs++;
+            if (legal_moves == 1)
+                first_move_cutoffs++;
+
+            // on quiet moves (a promotion is ordered by its own score, it doesn't need a killer slot)
+            if (quiet)
             {
                 // store killer moves
                 killer_moves[1][ply] = killer_moves[0][ply];
-                killer_moves[0][ply] = move_list.moves[count];
+                killer_moves[0][ply] = move;
 
             }
+
+            // a quiet move that cuts off gets a history bonus and the quiet moves before it a penalty
+            if (quiet)
+                UpdateQuietHistories(move, quiets_tried, quiet_count, depth);
             
+            // store the cutoff, the score is a lower bound
+            transposition_table.Store(hash_key, depth, hash_beta, ScoreToTable(score, ply), move);
             
-            // return beta value
-            return beta;
+            // return the move's score
+            return score;
         }
 
+        // this quiet move failed to cut off
+        if (quiet)
+            quiets_tried[quiet_count++] = move;
+
         // we have found a better move than previous best move
         if (score > alpha)
         {
             // update the alpha value
             alpha = score; 
+            best_move = move;
 
             // write PV move
-            pv_table[ply][ply] = move_list.moves[count];
+            pv_table[ply][ply] = move;
 
             // loop over next ply
             for (int next_ply = ply + 1; next_ply < pv_length[ply + 1]; next_ply++)
@@ -1150,67 +1983,87 @@ int Board::NegaMax(int alpha, int beta, int depth)
             // adjust PV length
             pv_length[ply] = pv_length[ply + 1];
         }
-
-
-       
     }
 
     // no legal moves to make in this position
-    if (legal_moves == 0)   
+    if (legal_moves == 0)
     {
         // king is in check
         if (in_check)
             // return mating score ( + ply is so that it finds sooner checkmates)
-            return -49000 + ply;
+            return -mate_value + ply;
         else
             // return stalemate score
             return 0;
-    } 
-    return alpha;
+    }
+
+    // a move that raised alpha makes the score exact, otherwise the best score is an upper bound
+    transposition_table.Store(hash_key, depth, (alpha > original_alpha) ? hash_exact : hash_alpha, ScoreToTable(best_score, ply), best_move);
+
+    return best_score;
 
 }
 
 
 /* Recursive perft function to traverse the tree of moves to a given depth */
-int Board::perft(int depth){
+U64 Board::perft(int depth){
 
     // If the depth is 0, we reached a leaf node so return 1
     if (depth == 0) 
+    {
+        perft_leaves++;
         return 1;
+    }
+
+    // One ply above the leaves the moves only need counting, not playing
+    if (depth == 1)
+    {
+        int count = CountLegalMoves();
+        perft_leaves += count;
+        return count;
+    }
 
     // otherwise search through all of the nodes in this tree
     else
     {
+        // init num of nodes searched
+        U64 nodes = 0;
+
+        // a subtree counted before (through another move order) is taken from the hash table. Depth 1 subtrees
+        // are cheaper to count again than to look up
+        if (perft_table && depth >= 2)
+        {
+            perft_probes++;
+            if (perft_table->Probe(hash_key, depth, nodes))
+            {
+                perft_hits++;
+                return nodes;
+            }
+        }
+
         // init the list of moves
         MoveList moves;
 
-        // init num of nodes searched
-        int nodes = 0;
-
         // generate all moves for this board state
         GenerateMoves(&moves);
 
         // iterate over every move
-        for (int i = 0; i < moves.count; i++){
-            
-
-            // grab the move from the MoveList object
-            int move = moves.moves[i];
+        for (int move : moves){
 
-            // copy the board to restore move later
-            copy_board();
-
-            // make the move. If it is an illegal move, then continue
-            if(!MakeMove(move, all_moves))
-                continue;
+            // make the move, every generated move is legal
+            MakeMove(move);
 
             // recursively call the perft function for a depth of -1
             nodes += perft(depth-1);
 
             // restore the board state
-            take_back();
+            UnmakeMove(move);
         }
 
+        // remember the count for the next time this position comes up at this depth
+        if (perft_table && depth >= 2)
+            perft_table->Store(hash_key, depth, nodes);
+
         return nodes;
 
     }
@@ -1273,103 +2126,215 @@ int Board::Evaluate()
     return (turn_to_move == white) ? score : -score;
 }
 
-/* Returns a numerical score that ranks the strength of the given move. Used for earlier beta-cutoffs */
-int Board::ScoreMove(int move)
+// Largest magnitude a history score reaches, the bonuses shrink as a score gets close to it
+static const int history_max = 16384;
+
+/* Adds a bonus (or a penalty, if negative) to a history score. The closer the score already is to history_max in
+that direction the less it moves (gravity), so scores stay within +-history_max and old results fade as new ones
+come in, rather than piling up until they drown out whatever the current part of the tree shows */
+template <typename T> static void ApplyHistoryBonus(T &entry, int bonus)
 {
+    entry += bonus - entry * abs(bonus) / history_max;
+}
 
-    // score a capture move
-    if (get_move_capture(move))
-    {   
-        // init a target piece that is being captured
-        int target_piece = P;
+/* Returns the continuation history table of the move made plies_back plies before the current node, or nullptr if
+there is no such move (or the board has no continuation history) */
+Board::PieceToHistory *Board::ContinuationHistory(int plies_back)
+{
+    if (!continuation_history || ply < plies_back || moved_piece[ply - plies_back] == no_piece)
+        return nullptr;
 
-        // to loop over bitboards and find what piece is being captured
-        int start_piece, end_piece;
+    return &continuation_history[moved_piece[ply - plies_back] * 64 + moved_to[ply - plies_back]];
+}
 
-        // If white, then loop through white pawns to white king, otherwise black pawns to black king
-        start_piece = (turn_to_move == white) ? p : P;
-        end_piece = (turn_to_move == white) ? k : K;
+/* Returns the history score of a quiet move: how often the piece moving to that square failed high, plus how often
+it did in reply to the opponent's last move and as a follow-up to our own move before that */
+int Board::QuietHistory(int move)
+{
+    int piece = piece_on[get_move_source(move)];
+    int target = get_move_target(move);
 
-        int target_square = get_move_target(move);
+    int score = history_moves[piece][target];
 
-        // loop through all the piece bitboard
-        for (int piece = start_piece; piece <= end_piece; piece++)
-        {   
-            // if there is a piece on that square
-            if (get_bit(pieces[piece], target_square))
-            {
-                // set our target piece to that piece and break
-                target_piece = piece;
-                break;
-            }
-        }
-        // score move by MVV LVA lookup [source piece][target piece]
-        return mvv_lva[get_move_piece(move)][target_piece];
+    for (int plies_back = 1; plies_back <= 2; plies_back++)
+    {
+        PieceToHistory *history = ContinuationHistory(plies_back);
+        if (history)
+            score += (*history)[piece][target];
+    }
+
+    return score;
+}
 
+/* Updates the histories after a quiet move failed high at the given depth. It gets a bonus growing with the square
+of the depth (a cutoff deep in the tree saves more), the quiet moves searched before it the same as a penalty, since
+they were ordered too early. The move also becomes the countermove to the opponent's last move */
+void Board::UpdateQuietHistories(int move, Move *quiets_tried, int quiet_count, int depth)
+{
+    int bonus = min(16 * depth * depth, 1200);
 
-    }
+    // the continuation histories of the last two moves, if they were real moves
+    PieceToHistory *histories[2] = {ContinuationHistory(1), ContinuationHistory(2)};
 
-    // score quiet move
-    else
+    // the move that failed high gets the bonus, the ones before it the penalty
+    for (int index = -1; index < quiet_count; index++)
     {
-        // score 1st killer move
-        if (killer_moves[0][ply] == move)
-            return 9000;
+        int quiet = (index < 0) ? move : quiets_tried[index];
+        int piece = piece_on[get_move_source(quiet)];
+        int target = get_move_target(quiet);
+        int change = (index < 0) ? bonus : -bonus;
 
-        // score 2nd killer move
-        else if (killer_moves[1][ply] == move)
-            return 8000;
+        ApplyHistoryBonus(history_moves[piece][target], change);
+
+        for (PieceToHistory *history : histories)
+            if (history)
+                ApplyHistoryBonus((*history)[piece][target], change);
     }
 
-    return 0;
+    // remember the move as the refutation of the opponent's last move
+    if (ply > 0 && moved_piece[ply - 1] != no_piece)
+        counter_moves[moved_piece[ply - 1]][moved_to[ply - 1]] = move;
 }
 
-/* Sorts the moves in descending moves so best move is searched first */
-void Board::SortMoves(MoveList *move_list)
+/* Returns a numerical score that ranks the strength of the given move. Used for earlier beta-cutoffs. Moves are
+scored in bands: captures and promotions (by MVV LVA) first, then the killer moves, then the countermove, then the
+other quiet moves by their history */
+int Board::ScoreMove(int move)
 {
-    // initialize all of the move scores
-    int move_scores[move_list->count];
 
-    // iterate over all of the moves
-    for (int count = 0; count < move_list->count; count++)
-        // populate the move_scores array with the scores of the moves
-        move_scores[count] = ScoreMove(move_list->moves[count]);
-    
+    // score a capture move
+    if (get_move_capture(move))
+    {   
+        // the captured piece, en passant always takes a pawn (of the other color) from an empty target square
+        int victim = get_move_enpassant(move) ? (P + (turn_to_move ^ 1) * 6) : piece_on[get_move_target(move)];
+
+        // score move by MVV LVA lookup [source piece][captured piece]
+        return 1000000 + mvv_lva[piece_on[get_move_source(move)]][victim];
+    }
+
+    // promotions (to a queen first) come with the captures
+    if (get_move_promoted(move))
+        return 1000000 + get_move_promoted(move);
 
-    // keeps track of whether bubble sort performs a swap or not (if it doesn't then array is sorted)
-    bool has_swapped = true;
+    // score 1st killer move
+    if (killer_moves[0][ply] == move)
+        return 900000;
 
-    // iterate until has_swapped is not true
-    while(has_swapped)
+    // score 2nd killer move
+    if (killer_moves[1][ply] == move)
+        return 800000;
+
+    // score the countermove to the opponent's last move
+    if (ply > 0 && moved_piece[ply - 1] != no_piece && counter_moves[moved_piece[ply - 1]][moved_to[ply - 1]] == move)
+        return 700000;
+
+    // score any other quiet move by its history
+    return QuietHistory(move);
+}
+
+// Piece values for the static exchange evaluation, by piece type, matching the material scores of the evaluation
+static const int exchange_values[6] = {100, 300, 350, 500, 1000, 10000};
+
+/* Works out what a capture (or promotion) wins once both sides have made every recapture on its target square that
+pays off for them. The pieces attacking the square are found with the move tables, and each capture is made by the
+least valuable attacker left. Taking a piece off the occupancy uncovers the sliders behind it (x-rays), which are
+added to the attackers as they appear. The gains of the exchange are then rolled back from the end, as either side
+can stop recapturing when it would only lose more. Promotions along the way (other than by the move itself) and pins
+are ignored */
+int Board::StaticExchange(int move)
+{
+    int source = get_move_source(move);
+    int target = get_move_target(move);
+
+    // gain[n] is the material won by the side making the n-th capture, if the exchange stopped there
+    int gain[32];
+    int exchange = 0;
+
+    // the first capture takes whatever is on the target square (a pawn for en passant), a promotion also swaps the
+    // pawn for the new piece
+    int piece_value = exchange_values[piece_on[source] % 6];
+    int captured = get_move_enpassant(move) ? P : piece_on[target];
+    gain[0] = (captured != no_piece) ? exchange_values[captured % 6] : 0;
+    if (get_move_promoted(move))
     {
-        // start each iteration with no swaps
-        has_swapped = false;
+        gain[0] += exchange_values[get_move_promoted(move)] - exchange_values[P];
+        piece_value = exchange_values[get_move_promoted(move)];
+    }
 
-        // iterate through all of the moves (up to but not including the last move)
-        for (int i = 0; i < (move_list->count - 1); i++)
-        {
-            // if the next move is better than the current move
-            if (move_scores[i+1] > move_scores[i])
-            {
-                // keep track of temp variable to swap
-                int temp_move = move_list->moves[i];
+    // the board after the first capture, an en passant capture also takes away the pawn behind the target square
+    U64 occupancy = occupancies[both] ^ (1ULL << source);
+    if (get_move_enpassant(move))
+        occupancy ^= 1ULL << (target + ((turn_to_move == white) ? -8 : 8));
 
-                // swap the moves
-                move_list->moves[i] = move_list->moves[i+1];
-                move_list->moves[i + 1] = temp_move;
+    // every piece of both sides attacking the square, and the sliders that could turn up behind them
+    U64 attackers = (AttackersOf<white>(target, occupancy) | AttackersOf<black>(target, occupancy)) & occupancy;
+    U64 diagonal_sliders = pieces[B] | pieces[b] | pieces[Q] | pieces[q];
+    U64 straight_sliders = pieces[R] | pieces[r] | pieces[Q] | pieces[q];
 
-                //swap the scores
-                int temp_score = move_scores[i];
-                move_scores[i] = move_scores[i + 1];
-                move_scores[i + 1] = temp_score;
+    // the sides take turns recapturing, starting with the opponent
+    int side = turn_to_move ^ 1;
+    while (true)
+    {
+        // the side's least valuable piece attacking the square, none left ends the exchange
+        U64 side_attackers = attackers & occupancies[side];
+        if (!side_attackers)
+            break;
 
-                // indicate that a swap has occurred
-                has_swapped = true;
-            }
-        }
+        int piece_type = P;
+        while (!(side_attackers & pieces[piece_type + side * 6]))
+            piece_type++;
+
+        // the king can't recapture onto a square the other side still attacks
+        if (piece_type == K && (attackers & occupancies[side ^ 1]))
+            break;
+
+        // the side takes the piece on the square, which is a loss for it if the exchange stops there
+        exchange++;
+        gain[exchange] = piece_value - gain[exchange - 1];
+        piece_value = exchange_values[piece_type];
+
+        // there are never more captures than pieces
+        if (exchange == 31)
+            break;
+
+        // take the capturing piece off the board and add the sliders it uncovers
+        occupancy ^= 1ULL << BitScan(side_attackers & pieces[piece_type + side * 6]);
+        attackers |= (move_calc.GetBishopAttacks(target, occupancy) & diagonal_sliders)
+                   | (move_calc.GetRookAttacks(target, occupancy) & straight_sliders);
+        attackers &= occupancy;
+
+        side ^= 1;
     }
 
+    // each side only makes a capture if it does better than stopping before it
+    while (exchange > 0)
+    {
+        gain[exchange - 1] = -max(-gain[exchange - 1], gain[exchange]);
+        exchange--;
+    }
+
+    return gain[0];
+}
+
+/* Sorts the moves in descending order of their scores so the best move is searched first. Moves with equal scores
+keep the order they were generated in. Only the root moves are fully sorted (once per search), the move picker picks
+the moves of every other node one at a time */
+void Board::SortMoves(MoveList *move_list)
+{
+    // pair every move with its score
+    ScoredMove scored_moves[max_moves];
+
+    // iterate over all of the moves
+    for (int count = 0; count < move_list->count; count++)
+        // score the move
+        scored_moves[count] = {move_list->moves[count], ScoreMove(move_list->moves[count])};
 
+    // best scores first
+    stable_sort(scored_moves, scored_moves + move_list->count, [](const ScoredMove &a, const ScoredMove &b) { return a.score > b.score; });
+
+    // write the moves back in their sorted order
+    for (int count = 0; count < move_list->count; count++)
+        move_list->moves[count] = scored_moves[count].move;
 }
 
 /* Calls the board's constructor to reset it to the original start position */
@@ -1398,15 +2363,9 @@ string Board::GenerateFEN(){
             // get the square index
             int square = rank * 8 + file;
 
-            // iterate over every piece type
-            for (int piece = P; piece <= k; piece++)
-            {
-
-                // if the bit on this square is occupied, it is of type piece
-                if (get_bit(pieces[piece], square)){
-                    piece_str = piece_to_str[piece];
-                }
-            }
+            // look up the piece standing on this square
+            if (piece_on[square] != no_piece)
+                piece_str = piece_to_str[piece_on[square]];
 
 
             // if a piece was found 
@@ -1465,19 +2424,12 @@ void Board::Display(){
             // Init the square
             int square = rank * 8 + file;
 
-            // Initialize the piece as -1 (indicates a blank)
-            int piece = -1;
+            // Look up the piece on this square
+            int piece = piece_on[square];
 
-            // Checks to see if there is a piece on this square
-            for (int bb_piece=P; bb_piece <= k; bb_piece++)
-            {
-                // If one of the bitboards has a piece on that square, set the piece to the appropriate one
-                if (get_bit(pieces[bb_piece], square)) piece = bb_piece;
-            }
-
-            // If the piece is -1 just print out a dot, otherwise print out the ASCII for the piece
-            string piece_str = (piece == -1) ? "." : ascii[piece];
-            cout << ascii[piece] << "  ";
+            // If the square is empty just print out a dot, otherwise print out the ASCII for the piece
+            string piece_str = (piece == no_piece) ? "." : ascii[piece];
+            cout << piece_str << "  ";
         }
         
         // Print a new rank
@@ -1489,6 +2441,9 @@ void Board::Display(){
     // Prints the current player's turn
     printf("Side to move:\t%s\n", turn_to_move ? "black" : "white");
 
+    // Number of legal moves for the side to move
+    cout << "Legal moves:\t" << CountLegalMoves() << endl;
+
     // Retrieves the en passant square (if that is possible) and prints it out
     cout << "En passant:\t" << ((enpassant == no_sq) ? "No" : square_index[enpassant]) << endl;
 
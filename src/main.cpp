@@ -8,14 +8,20 @@
 #include "move_calc.h"
 #include "utils.h"
 #include "board.h"
+#include "perft_table.h"
+#include "perft_suite.h"
+#include "transposition_table.h"
+#include "search.h"
+#include "bench.h"
 
 using namespace std;
 
-int max_ply = 64;
-
 // initialize the board object
 Board board = Board();
 
+// the search, run on the board's position
+Search searcher;
+
 /* Handles the position command from GUI for UCI protocol */
 void parse_position(string input_line)
 {
@@ -74,117 +80,171 @@ void parse_position(string input_line)
     }
 }
 
+/* Handles the go command. A search runs in the background and prints its bestmove once done, perft runs straight
+away */
 void parse_go(string input_line)
 {
     // create a stringstream to split by spaces and a token to contain the tokens
     stringstream ss(input_line);
     string token;
 
-    // Create a string 
-    int depth;
-
     // read the go command
     ss >> token;
 
-    // read the next argument of the command
-    ss >> token;
-
     // handle if we are doing a perft test
-    if (token == "perft")
+    if (input_line.rfind("go perft", 0) == 0)
     {   
         // read in the perft depth
-        ss >> token;
+        ss >> token >> token;
+        int perft_depth = stoi(token);
+
+        // read the optional number of threads and hash table size in megabytes (go perft 7 threads 8 hash 256)
+        int threads = 1;
+        int hash_mb = 0;
+        while (ss >> token)
+        {
+            if (token == "threads" && ss >> token)
+                threads = max(1, stoi(token));
+            else if (token == "hash" && ss >> token)
+                hash_mb = max(0, stoi(token));
+        }
+
+        // the hash table, if asked for, allocated before the timed run
+        unique_ptr<PerftTable> perft_table;
+        if (hash_mb > 0)
+            perft_table = make_unique<PerftTable>(hash_mb);
 
-        // call the perft driver function with the depth (converted to int)
-        board.perft_driver(stoi(token));
+        // call the perft driver function with the depth, threads and hash table
+        board.perft_driver(perft_depth, threads, perft_table.get());
 
         // break out of function early after perft test
         return;
     }
 
-    // if we are given a depth argument
-    else if (token == "depth")
-    {
-        // read in the actual depth
-        ss >> token;
-
-        // get the depth from the command
-        depth = stoi(token);
+    // the search's limits, and whether a depth was given
+    SearchLimits limits;
+    bool depth_given = false;
 
-    }
-
-    // if we are given a movetime argument
-    else if (token == "movetime")
+    // read every argument of the command
+    while (ss >> token)
     {
+        // how deep to search
+        if (token == "depth" && ss >> token)
+        {
+            limits.depth = stoi(token);
+            depth_given = true;
+        }
 
-        // read in the amount of milliseconds
-        ss >> token;
+        // deepen the search until that many milliseconds have passed
+        else if (token == "movetime" && ss >> token)
+            limits.move_time = stoi(token);
+
+        // the clocks, the time manager works out how long to spend from these
+        else if (token == "wtime" && ss >> token)
+            limits.time[white] = max(1, stoi(token));
+        else if (token == "btime" && ss >> token)
+            limits.time[black] = max(1, stoi(token));
+        else if (token == "winc" && ss >> token)
+            limits.increment[white] = stoi(token);
+        else if (token == "binc" && ss >> token)
+            limits.increment[black] = stoi(token);
+        else if (token == "movestogo" && ss >> token)
+            limits.moves_to_go = stoi(token);
+
+        // search until stop
+        else if (token == "infinite")
+            limits.infinite = true;
+
+        // search on the opponent's time until ponderhit or stop
+        else if (token == "ponder")
+            limits.ponder = true;
+    }
 
-        // get the move depth from the command
-        int move_time = stoi(token);
+    // searches limited by time (or by nothing but stop) go as deep as they get, with no limit at all default to a
+    // depth of 7
+    bool timed = limits.move_time || limits.time[board.turn_to_move];
+    if (!depth_given && !timed && !limits.infinite && !limits.ponder)
+        limits.depth = 7;
 
-        // Start measuring time
-        auto start = chrono::steady_clock::now();
+    // Pondering without a clock or a depth leaves nothing for ponderhit to time the search by, so it is an infinite
+    // search on purpose: after ponderhit it keeps going until stop, like go infinite
+    if (limits.ponder && !depth_given && !timed)
+        limits.infinite = true;
 
-        // start at ply of 1
-        int current_depth = 1;
+    // search with every thread in the background, printing the info lines and the bestmove
+    searcher.Start(board, limits);
+}
 
-        // while the current time minus start time (* 1000 for milliseconds) is less than the move time, search for moves
-        while ((chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count() < move_time) && current_depth < max_ply)
-        {
-            // use negamax to calculate best move to a certain depth
-            int score = board.GetBestMove(current_depth);
+/* Handles the perftsuite command (perftsuite <file.epd> [depth N] [threads T] [hash MB]), returns true if every
+count in the suite matched */
+bool parse_perftsuite(string input_line)
+{
+    stringstream ss(input_line);
+    string token;
 
-            // print search information out for gui usage
-            cout << "info score cp " << score << " depth " <<  current_depth << " nodes " << board.nodes << " pv ";
+    // read the perftsuite command and the file name
+    ss >> token;
+    string path;
+    ss >> path;
+
+    // read the optional depth limit, number of threads and hash table size
+    int max_depth = 0;
+    int threads = 1;
+    int hash_mb = 0;
+    while (ss >> token)
+    {
+        if (token == "depth" && ss >> token)
+            max_depth = max(0, stoi(token));
+        else if (token == "threads" && ss >> token)
+            threads = max(1, stoi(token));
+        else if (token == "hash" && ss >> token)
+            hash_mb = max(0, stoi(token));
+    }
 
-            // Iterate over all PV moves
-            for (int count = 0; count < board.pv_length[0]; count++)
-            {   
-                // print each of the PV moves
-                PrintMove(board.pv_table[0][count]);
-                cout << " ";
-            }
-            cout << endl;
+    return RunPerftSuite(path, max_depth, threads, hash_mb);
+}
 
-            // increment the current depth 1
-            current_depth ++;
+/* Handles the setoption command (setoption name <id> value <x>) */
+void parse_setoption(string input_line)
+{
+    stringstream ss(input_line);
+    string token, name, value;
 
-        }
+    // read the setoption and name words
+    ss >> token >> token;
 
-        // print out that move to standard output
-        cout << "bestmove ";
-        PrintMove(board.pv_table[0][0]);
-        cout << endl;
-        return;
+    // the option name runs up to the value word, the value is the rest
+    while (ss >> token && token != "value")
+        name += (name.empty() ? "" : " ") + token;
+    ss >> value;
 
-    }
-    else
+    // size of the transposition table in megabytes, never changed under a running search
+    if (name == "Hash" && !value.empty())
     {
-        // otherwise default to a depth of 7
-        depth = 7;
+        searcher.Stop();
+        transposition_table.Resize(max(1, stoi(value)));
     }
 
-    // use negamax to calculate best move to a certain depth
-    int score = board.GetBestMove(depth);
+    // number of threads searching together
+    if (name == "Threads" && !value.empty())
+        searcher.SetThreads(max(1, stoi(value)));
 
-    // print search information out for gui usage
-    cout << "info score cp " << score << " depth " <<  depth << " nodes " << board.nodes << " pv ";
-
-    // Iterate over all PV moves
-    for (int count = 0; count < board.pv_length[0]; count++)
-    {   
-        // print each of the PV moves
-        PrintMove(board.pv_table[0][count]);
-        cout << " ";
+    // pruning and reductions can be switched off to measure what they gain
+    if (name == "NullMovePruning" && !value.empty())
+    {
+        searcher.Stop();
+        Board::null_move_pruning = (value == "true");
     }
-    cout << endl;
 
-    // print out that move to standard output
-    cout << "bestmove ";
-    PrintMove(board.pv_table[0][0]);
-    cout << endl;
+    if (name == "LateMoveReductions" && !value.empty())
+    {
+        searcher.Stop();
+        Board::late_move_reductions = (value == "true");
+    }
 
+    // time kept back from the clock for communication delays
+    if (name == "Move Overhead" && !value.empty())
+        TimeManager::move_overhead = max(0, stoi(value));
 }
 
 /* Controls the main input/output loop for UCI protocol */
@@ -197,14 +257,23 @@ void uci_loop()
     cout << "id name SpaghettiChess" << endl;
     cout << "id author Seth Bassetti" << endl;
 
+    // Tell the GUI which options can be set
+    cout << "option name Hash type spin default 16 min 1 max 65536" << endl;
+    cout << "option name Threads type spin default 1 min 1 max 256" << endl;
+    cout << "option name Ponder type check default false" << endl;
+    cout << "option name Move Overhead type spin default 30 min 0 max 5000" << endl;
+    cout << "option name NullMovePruning type check default true" << endl;
+    cout << "option name LateMoveReductions type check default true" << endl;
+
     // Tell the GUI we are in UCI mode and ready to process commands
     cout << "uciok" << endl;
 
     // Main input/output loop
     while (true)
     {
-        // Reads any input from the line
-        std::getline(cin, input_line);
+        // Reads any input from the line, the end of the input counts as quit
+        if (!std::getline(cin, input_line))
+            input_line = "quit";
 
         // Read in if position command is given
         if (input_line.rfind("position", 0) == 0)
@@ -223,11 +292,35 @@ void uci_loop()
             parse_go(input_line);
         }
 
+        // stop the search, it prints its bestmove
+        else if(input_line == "stop")
+        {
+            searcher.Stop();
+        }
+
+        // the opponent played the move the engine was pondering on, carry on searching on our own time
+        else if(input_line == "ponderhit")
+        {
+            searcher.PonderHit();
+        }
+
         // if ucinewgame command is sent
         else if(input_line == "ucinewgame")
         {   
+            // a new game doesn't start under a running search
+            searcher.Stop();
+
             // init the board with the default starting position
             parse_position("position startpos");
+
+            // nothing from the last game carries over
+            transposition_table.Clear();
+        }
+
+        // if setoption command is sent
+        else if(input_line.rfind("setoption", 0) == 0)
+        {
+            parse_setoption(input_line);
         }
 
 
@@ -242,9 +335,37 @@ void uci_loop()
             cout << "score for " << ((board.turn_to_move) ? "black" : "white") << ": " << board.Evaluate() << endl;
         }
 
-        // if quit command is given, exit the while loop
+        // if bench command is sent (bench [depth]), search the bench positions and report the nodes and speed
+        else if(input_line.rfind("bench", 0) == 0)
+        {
+            stringstream ss(input_line);
+            string token;
+            int depth = 10;
+            ss >> token;
+            if (ss >> token)
+                depth = stoi(token);
+
+            RunBench(searcher, depth);
+        }
+
+        // if perftsuite command is sent, check move generation against an EPD file of perft counts
+        else if(input_line.rfind("perftsuite", 0) == 0)
+        {
+            parse_perftsuite(input_line);
+        }
+
+        // if sliders command is sent, cross-check and benchmark the slider attack backends
+        else if(input_line == "sliders")
+        {
+            move_calc.TestSliderBackends();
+        }
+
+        // if quit command is given, stop any search and exit the while loop
         else if(input_line == "quit")
+        {
+            searcher.Stop();
             break;
+        }
 
         // reset the input line every iteration of the for loop
         input_line = "";
@@ -253,7 +374,25 @@ void uci_loop()
 
 }
 
-int main(){
+int main(int argc, char *argv[]){
+
+    // run the bench straight from the command line (main bench [depth])
+    if (argc > 1 && string(argv[1]) == "bench")
+    {
+        RunBench(searcher, (argc > 2) ? stoi(argv[2]) : 10);
+        return 0;
+    }
+
+    // run a perft suite straight from the command line (main perftsuite file.epd [depth N] ...), exiting with 1 if
+    // any count didn't match so builds can use it as a check
+    if (argc > 1 && string(argv[1]) == "perftsuite")
+    {
+        string command;
+        for (int i = 1; i < argc; i++)
+            command += string(argv[i]) + " ";
+
+        return parse_perftsuite(command) ? 0 : 1;
+    }
 
     // init msg variable from gui to engine
     string msg;
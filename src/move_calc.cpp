@@ -1,11 +1,20 @@
 #include <string.h>
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
+
+#ifdef __x86_64__
+#include <cpuid.h>
+#endif
 
 #include "utils.h"
 #include "move_calc.h"
 
 
-/* Constructor for MoveCalculator class. Initializes all pre-calculated attack tables */
-MoveCalc::MoveCalc()
+/* Constructor for MoveCalculator class. Initializes all pre-calculated attack tables. Every function it
+calls is constexpr so that the whole object can be built by the compiler (see move_calc below) */
+constexpr MoveCalc::MoveCalc()
 {   
     // Initialize the slider moves for bishops and rooks
     InitSliderMoves(bishop);
@@ -13,11 +22,14 @@ MoveCalc::MoveCalc()
     
     // Initializes leaper move attack tables for kings and knights
     InitLeaperMoves();
+
+    // Initializes the tables of squares between and along aligned squares
+    InitLineTables();
 }
 
 /* Given a color and a square on the board, returns a bitboard representing where a pawn on that square
 could attack*/
-U64 MoveCalc::CalcPawnAttacks(int square, int side){
+constexpr U64 MoveCalc::CalcPawnAttacks(int square, int side){
 
     // Stores the attacks
     U64 attacks = 0ULL;
@@ -57,7 +69,7 @@ U64 MoveCalc::CalcPawnAttacks(int square, int side){
 }
 
 /* Returns a bitboard of locations a king could attack if it were on a given square */
-U64 MoveCalc::CalcKingAttacks(int square){
+constexpr U64 MoveCalc::CalcKingAttacks(int square){
     // Stores the attacks
     U64 attacks = 0ULL;
 
@@ -85,7 +97,7 @@ U64 MoveCalc::CalcKingAttacks(int square){
     return attacks;
 }
 
-U64 MoveCalc::CalcKnightAttacks(int square)
+constexpr U64 MoveCalc::CalcKnightAttacks(int square)
 {
     // Stores the attacks
     U64 attacks = 0ULL;
@@ -110,13 +122,13 @@ U64 MoveCalc::CalcKnightAttacks(int square)
 }
 
 /* Mask bishop attacks for magic bitboard */
-U64 MoveCalc::MaskBishopAttacks(int square)
+constexpr U64 MoveCalc::MaskBishopAttacks(int square)
 {
     // result attacks bitboard
     U64 attacks = 0ULL;
 
     // init rank and file
-    int r, f;
+    int r = 0, f = 0;
 
     // init target rank & files
     int tgt_r = square / 8;
@@ -133,13 +145,13 @@ U64 MoveCalc::MaskBishopAttacks(int square)
 }
 
 /* Mask rook attacks for magic bitboard */
-U64 MoveCalc::MaskRookAttacks(int square)
+constexpr U64 MoveCalc::MaskRookAttacks(int square)
 {
     // Result attacks bitboard
     U64 attacks = 0ULL;
 
     // init rank and file
-    int r, f;
+    int r = 0, f = 0;
 
     // init target rank and file
     int tgt_r = square / 8;
@@ -157,13 +169,13 @@ U64 MoveCalc::MaskRookAttacks(int square)
 
 
 /* Generate bishop attacks on the fly */
-U64 MoveCalc::BishopAttacksOnTheFly(int square, U64 block)
+constexpr U64 MoveCalc::BishopAttacksOnTheFly(int square, U64 block)
 {
     // result attacks bitboard
     U64 attacks = 0ULL;
 
     // init rank and file
-    int r, f;
+    int r = 0, f = 0;
 
     // init target rank & files
     int tgt_r = square / 8;
@@ -204,13 +216,13 @@ U64 MoveCalc::BishopAttacksOnTheFly(int square, U64 block)
 }
 
 /* Generate rook attacks on the fly */
-U64 MoveCalc::RookAttacksOnTheFly(int square, U64 block)
+constexpr U64 MoveCalc::RookAttacksOnTheFly(int square, U64 block)
 {
     // Result attacks bitboard
     U64 attacks = 0ULL;
 
     // init rank and file
-    int r, f;
+    int r = 0, f = 0;
 
     // init target rank and file
     int tgt_r = square / 8;
@@ -250,69 +262,73 @@ U64 MoveCalc::RookAttacksOnTheFly(int square, U64 block)
     return attacks;
 }
 
-U64 MoveCalc::SetOccupancy(int index, int bits_in_mask, U64 attack_map)
-{
-    // occupancy map
-    U64 occupancy_map = 0ULL;
-
-    // loop over the range of bits within attack mask
-    for (int count = 0; count < bits_in_mask; count++)
-    {
-        // Get LSB index of attack map
-        int square = BitScan(attack_map);
-
-        // Pop the least significant bit from attack map
-        pop_bit(attack_map, square);
-
-        // Make sure occupancy is on board
-        if (index & (1 << count))
-        {
-            occupancy_map |= (1ULL << square);
-        }
-    }
-
-    return occupancy_map;
-}
-
-/* Iterates through every square and index to construct all possible slider moves */
-void MoveCalc::InitSliderMoves(int bishop)
+/* Iterates through every square and blocker combination to construct all possible slider moves */
+constexpr void MoveCalc::InitSliderMoves(int bishop)
 {   
+    // Where the current square's slice starts within the shared tables
+    int offset = 0;
+
     // Constructs attacks for each square
     for(int square=0; square < 64; square++){
 
-        // init mask tables
-        rook_masks[square] = MaskRookAttacks(square);
-        bishop_masks[square] = MaskBishopAttacks(square);
-
-        // Retrieve the appropriate sliding piece attack map
-        U64 attack_mask = bishop ? bishop_masks[square] : rook_masks[square];
-
-        // Init relevant occupancy bit count and occupancy indices
-        int relevant_bits = count_bits(attack_mask);
-        int occupancy_indices = 1 << relevant_bits;
-
-        // Populate the rook attack table for each possible combination of blocking pieces
-        for(int index=0; index < occupancy_indices; index++)
+        // Retrieve the appropriate sliding piece attack mask, magic number and shift
+        U64 attack_mask = bishop ? MaskBishopAttacks(square) : MaskRookAttacks(square);
+        U64 magic = bishop ? bishop_magic_numbers[square] : rook_magic_numbers[square];
+        int relevant_bits = bishop ? bishop_relevant_bits[square] : rook_relevant_bits[square];
+
+        // Fill in the lookup entry for this square
+        SliderEntry &entry = bishop ? bishop_entries[square] : rook_entries[square];
+        entry.mask = attack_mask;
+        entry.magic = magic;
+        entry.shift = 64 - relevant_bits;
+        entry.attacks = bishop ? &bishop_attacks[offset] : &rook_attacks[offset];
+#ifdef PEXT_BACKEND
+        entry.pext_attacks = bishop ? &bishop_pext_attacks[offset] : &rook_pext_attacks[offset];
+#endif
+
+        // Start with no blockers at all
+        U64 occupancy = 0ULL;
+
+        // The carry-rippler visits subsets in increasing order, so a running count is exactly PEXT(occupancy, mask)
+        int pext_index = offset;
+
+        /* Populate the attack table for each possible combination of blocking pieces. The subsets of the mask are
+        walked with the carry-rippler trick ((occupancy - mask) & mask), which visits every combination once and
+        wraps back around to 0 at the end. This keeps the compile time evaluation of the tables cheap */
+        do
         {
-            // Construct a potential map of blockers
-            U64 occupancy = SetOccupancy(index, relevant_bits, attack_mask);
-            if(bishop){
-
-                // Generate the magic index and use it to populate the bishop attack table
-                int magic_index = (occupancy * bishop_magic_numbers[square]) >> (64 - bishop_relevant_bits[square]);
-                bishop_attacks[square][magic_index] = BishopAttacksOnTheFly(square, occupancy);
+            // Generate the magic index into this square's slice
+            int magic_index = offset + ((occupancy * magic) >> (64 - relevant_bits));
+
+            if (bishop)
+            {
+                // populate the bishop attack tables
+                bishop_attacks[magic_index] = BishopAttacksOnTheFly(square, occupancy);
+#ifdef PEXT_BACKEND
+                bishop_pext_attacks[pext_index] = bishop_attacks[magic_index];
+#endif
             }
             else
-            {   
-                // Generate the magic index and use it to populate the rook attack table
-                int magic_index = (occupancy * rook_magic_numbers[square]) >> (64 - rook_relevant_bits[square]);
-                rook_attacks[square][magic_index] = RookAttacksOnTheFly(square, occupancy);
+            {
+                // populate the rook attack tables
+                rook_attacks[magic_index] = RookAttacksOnTheFly(square, occupancy);
+#ifdef PEXT_BACKEND
+                rook_pext_attacks[pext_index] = rook_attacks[magic_index];
+#endif
             }
-        }
+
+            // Move on to the next combination of blockers
+            occupancy = (occupancy - attack_mask) & attack_mask;
+            pext_index++;
+
+        } while (occupancy);
+
+        // The next square's slice starts right after this one
+        offset += 1 << relevant_bits;
     }
 }
 
-void MoveCalc::InitLeaperMoves()
+constexpr void MoveCalc::InitLeaperMoves()
 {
     // initialize attack tables for knights and kings for every square
     for (int square = 0; square < 64; square++)
@@ -329,40 +345,164 @@ void MoveCalc::InitLeaperMoves()
     }
 }
 
-/* Uses magic bitboard technique to get bishop attacks */
-U64 MoveCalc::GetBishopAttacks(int square, U64 occupancy)
-{ 
-    // Generates relevant blockers
-    occupancy &= bishop_masks[square];
+/* For every pair of squares on a common rank, file or diagonal, stores the squares between them and the full line
+through them. A rook (or bishop) on each square, with the other square as the only blocker, sees exactly the
+squares between the two. With no blockers at all, what both see is the rest of the shared line */
+constexpr void MoveCalc::InitLineTables()
+{
+    for (int source = 0; source < 64; source++)
+    {
+        for (int target = 0; target < 64; target++)
+        {
+            U64 source_bitboard = 1ULL << source;
+            U64 target_bitboard = 1ULL << target;
+
+            // aligned on a rank or file
+            if (RookAttacksOnTheFly(source, 0ULL) & target_bitboard)
+            {
+                between_squares[source][target] = RookAttacksOnTheFly(source, target_bitboard) & RookAttacksOnTheFly(target, source_bitboard);
+                line_squares[source][target] = (RookAttacksOnTheFly(source, 0ULL) & RookAttacksOnTheFly(target, 0ULL)) | source_bitboard | target_bitboard;
+            }
 
-    // Obtains the index
-    occupancy *= bishop_magic_numbers[square];
+            // aligned on a diagonal
+            else if (BishopAttacksOnTheFly(source, 0ULL) & target_bitboard)
+            {
+                between_squares[source][target] = BishopAttacksOnTheFly(source, target_bitboard) & BishopAttacksOnTheFly(target, source_bitboard);
+                line_squares[source][target] = (BishopAttacksOnTheFly(source, 0ULL) & BishopAttacksOnTheFly(target, 0ULL)) | source_bitboard | target_bitboard;
+            }
+        }
+    }
+}
 
-    // Gets only relevant bits for the index
-    occupancy >>= 64 - bishop_relevant_bits[square];
+// The single set of attack tables used by the whole program. Declaring it constexpr forces the constructor
+// to run at compile time, so the finished tables are emitted straight into the executable's read-only data
+constexpr MoveCalc move_calc;
 
-    return bishop_attacks[square][occupancy];
+// The slider backend, chosen before main() runs
+int MoveCalc::slider_backend = MoveCalc::DetectSliderBackend();
 
+/* Queries CPUID to see if the processor supports the BMI2 instruction set (which includes PEXT) */
+bool MoveCalc::CpuHasPext()
+{
+#ifdef PEXT_BACKEND
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+
+    // Leaf 7 holds the extended feature flags, BMI2 is bit 8 of EBX
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1 << 8));
+#else
+    return false;
+#endif
 }
 
-/* Uses magic bitboard technique to get rook attacks */
-U64 MoveCalc::GetRookAttacks(int square, U64 occupancy)
-{ 
-    // Generates relevant blockers
-    occupancy &= rook_masks[square];
+/* Decides between the PEXT and magic slider backends based on the processor */
+int MoveCalc::DetectSliderBackend()
+{
+#ifdef PEXT_BACKEND
+    if (!CpuHasPext())
+        return magic_backend;
+
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
 
-    // Obtains the index
-    occupancy *= rook_magic_numbers[square];
+    // Leaf 0 holds the vendor string, "AuthenticAMD" starts with "Auth" in EBX
+    __get_cpuid(0, &eax, &ebx, &ecx, &edx);
+    bool amd = (ebx == 0x68747541);
 
-    // Gets only relevant bits for the index
-    occupancy >>= 64 - rook_relevant_bits[square];
+    // Leaf 1 holds the family (base family + extended family)
+    __get_cpuid(1, &eax, &ebx, &ecx, &edx);
+    int family = ((eax >> 8) & 0xf) + ((eax >> 20) & 0xff);
 
-    return rook_attacks[square][occupancy];
+    // AMD chips before Zen 3 (family 0x19) run PEXT in microcode, which is much slower than the magic multiply
+    if (amd && family < 0x19)
+        return magic_backend;
 
+    return pext_backend;
+#else
+    return magic_backend;
+#endif
 }
 
-/* Uses the union of rook and bishop attacks to construct a queen attack */
-U64 MoveCalc::GetQueenAttacks(int square, U64 occupancy)
+/* Verifies every slider backend against the on the fly attack calculation for every blocker combination on
+every square, then times each backend on the same set of random lookups and prints the results */
+void MoveCalc::TestSliderBackends() const
 {
-    return GetRookAttacks(square, occupancy) | GetBishopAttacks(square, occupancy);
+    // Small xorshift generator so every run uses the same occupancies
+    U64 seed = 0x9e3779b97f4a7c15ULL;
+    auto random = [&seed]() { seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17; return seed; };
+
+    // The PEXT backend can only be exercised if the CPU has the instruction, even when it isn't the one in use
+    bool test_pext = CpuHasPext();
+
+    // count of mismatching lookups
+    int errors = 0;
+
+    for (int square = 0; square < 64; square++)
+    {
+        for (int piece_type : {rook, bishop})
+        {
+            U64 attack_mask = (piece_type == bishop) ? bishop_entries[square].mask : rook_entries[square].mask;
+            U64 occupancy = 0ULL;
+
+            // Walk every combination of relevant blockers, with random noise on the irrelevant squares
+            do
+            {
+                U64 board_occupancy = occupancy | (random() & ~attack_mask);
+
+                if (piece_type == bishop)
+                {
+                    U64 expected = BishopAttacksOnTheFly(square, occupancy);
+                    errors += (GetMagicBishopAttacks(square, board_occupancy) != expected);
+#ifdef PEXT_BACKEND
+                    if (test_pext) errors += (GetPextBishopAttacks(square, board_occupancy) != expected);
+#endif
+                }
+                else
+                {
+                    U64 expected = RookAttacksOnTheFly(square, occupancy);
+                    errors += (GetMagicRookAttacks(square, board_occupancy) != expected);
+#ifdef PEXT_BACKEND
+                    if (test_pext) errors += (GetPextRookAttacks(square, board_occupancy) != expected);
+#endif
+                }
+
+                occupancy = (occupancy - attack_mask) & attack_mask;
+
+            } while (occupancy);
+        }
+    }
+
+    std::cout << "slider backend in use: " << ((slider_backend == pext_backend) ? "pext" : "magic") << std::endl;
+    std::cout << "cross-check " << (test_pext ? "magic/pext" : "magic") << " against on the fly attacks: "
+              << (errors ? "FAILED (" + std::to_string(errors) + " mismatches)" : "ok") << std::endl;
+
+    // Random squares and occupancies (roughly a quarter of the board filled) to benchmark the lookups on
+    const int lookups = 1 << 16;
+    std::vector<int> squares(lookups);
+    std::vector<U64> occupancies(lookups);
+    for (int i = 0; i < lookups; i++)
+    {
+        squares[i] = random() & 63;
+        occupancies[i] = random() & random();
+    }
+
+    // Times a rook + bishop lookup over all the occupancies a number of times and prints the lookup rate
+    auto benchmark = [&](const char *name, auto lookup)
+    {
+        const int rounds = 200;
+        U64 checksum = 0ULL;
+        auto start = std::chrono::steady_clock::now();
+
+        for (int round = 0; round < rounds; round++)
+            for (int i = 0; i < lookups; i++)
+                checksum += lookup(squares[i], occupancies[i]);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << name << ": " << (2.0 * rounds * lookups) / seconds / 1000000 << " million lookups per second"
+                  << " (checksum " << std::hex << checksum << std::dec << ")" << std::endl;
+    };
+
+    benchmark("magic", [this](int square, U64 occupancy) { return GetMagicRookAttacks(square, occupancy) ^ GetMagicBishopAttacks(square, occupancy); });
+#ifdef PEXT_BACKEND
+    if (test_pext)
+        benchmark("pext ", [this](int square, U64 occupancy) { return GetPextRookAttacks(square, occupancy) ^ GetPextBishopAttacks(square, occupancy); });
+#endif
 }
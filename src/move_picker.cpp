@@ -0,0 +1,242 @@
+#include <utility>
+
+#include "utils.h"
+#include "board.h"
+#include "move_picker.h"
+
+
+/* Sets up the picker for the board's current position. Whether the side to move is in check decides between the
+normal stages and the single evasion stage */
+MovePicker::MovePicker(Board *board, int hash_move, bool in_check)
+{
+    this->board = board;
+    this->hash_move = hash_move;
+    this->in_check = in_check;
+    captures_only = false;
+
+    // killer moves stored for this ply
+    killers[0] = board->killer_moves[0][board->ply];
+    killers[1] = board->killer_moves[1][board->ply];
+
+    // the move that last refuted the opponent's last move, if that was a real move
+    int ply = board->ply;
+    bool has_last_move = ply > 0 && board->moved_piece[ply - 1] != no_piece;
+    counter_move = has_last_move ? board->counter_moves[board->moved_piece[ply - 1]][board->moved_to[ply - 1]] : 0;
+
+    // start with the hash move
+    stage = hash_stage;
+    index = 0;
+    bad_captures.count = 0;
+    bad_index = 0;
+}
+
+/* Sets up a quiescence picker: the hash move, if it is a capture or promotion, and then the captures */
+MovePicker::MovePicker(Board *board, int hash_move)
+{
+    this->board = board;
+    this->hash_move = (get_move_capture(hash_move) || get_move_promoted(hash_move)) ? hash_move : 0;
+    in_check = false;
+    captures_only = true;
+
+    // no killers or countermove in quiescence
+    killers[0] = killers[1] = 0;
+    counter_move = 0;
+
+    // start with the hash move
+    stage = hash_stage;
+    index = 0;
+    bad_captures.count = 0;
+    bad_index = 0;
+}
+
+/* Returns the next move to search, moving on through the stages (and generating their moves) whenever the current
+one runs out. Returns 0 when there are no moves left */
+int MovePicker::NextMove()
+{
+    // the cases fall through into the next stage when they have nothing (more) to hand out
+    switch (stage)
+    {
+        case hash_stage:
+        {
+            // in check everything after the hash move comes from the evasion stage
+            stage = in_check ? init_evasions_stage : init_captures_stage;
+
+            // the hash move may come from another position so make sure it can be played here
+            if (hash_move && board->IsLegalMove(hash_move))
+                return hash_move;
+
+            // otherwise there is no hash move to exclude from the later stages
+            hash_move = 0;
+            return NextMove();
+        }
+
+        case init_captures_stage:
+            // generate the captures and promotions, to be picked most valuable victims first
+            board->GenerateMoves(&move_list, only_captures);
+            ScoreMoves(false);
+            index = 0;
+            stage = captures_stage;
+            [[fallthrough]];
+
+        case captures_stage:
+            while (index < move_list.count)
+            {
+                int move = PickBest();
+                if (move == hash_move)
+                    continue;
+
+                // A capture that loses material is put off until after the quiet moves, quiescence doesn't search
+                // it at all: it would only make the side to move worse off than standing pat
+                if (IsLosingCapture(move))
+                {
+                    if (!captures_only)
+                        bad_captures.moves[bad_captures.count++] = move;
+                    continue;
+                }
+
+                return move;
+            }
+
+            // quiescence is done after the captures
+            if (captures_only)
+            {
+                stage = done_stage;
+                return 0;
+            }
+            stage = first_killer_stage;
+            [[fallthrough]];
+
+        case first_killer_stage:
+            stage = second_killer_stage;
+
+            // Killers are quiet moves from a sibling position, so try it if it is legal here. Captures and
+            // promotions were already handed out in the previous stage
+            if (IsQuietRefutation(killers[0]) && board->IsLegalMove(killers[0]))
+                return killers[0];
+
+            // don't exclude a killer that wasn't tried
+            killers[0] = 0;
+            [[fallthrough]];
+
+        case second_killer_stage:
+            stage = counter_move_stage;
+
+            // same for the second killer, which can only be the first killer if they were both reset
+            if (IsQuietRefutation(killers[1]) && killers[1] != killers[0] && board->IsLegalMove(killers[1]))
+                return killers[1];
+
+            // don't exclude a killer that wasn't tried
+            killers[1] = 0;
+            [[fallthrough]];
+
+        case counter_move_stage:
+            stage = init_quiets_stage;
+
+            // the countermove, unless it was one of the killers
+            if (IsQuietRefutation(counter_move) && counter_move != killers[0] && counter_move != killers[1]
+                && board->IsLegalMove(counter_move))
+                return counter_move;
+
+            // don't exclude a countermove that wasn't tried
+            counter_move = 0;
+            [[fallthrough]];
+
+        case init_quiets_stage:
+            // the quiet moves replace the captures in the list, ordered by their history
+            move_list.count = 0;
+            board->GenerateMoves(&move_list, only_quiets);
+            ScoreMoves(true);
+            index = 0;
+            stage = quiets_stage;
+            [[fallthrough]];
+
+        case quiets_stage:
+            while (index < move_list.count)
+            {
+                int move = PickBest();
+                if (!AlreadyTried(move))
+                    return move;
+            }
+            stage = bad_captures_stage;
+            [[fallthrough]];
+
+        case bad_captures_stage:
+            // the losing captures, in the order they were put off (most valuable victim first)
+            if (bad_index < bad_captures.count)
+                return bad_captures.moves[bad_index++];
+
+            stage = done_stage;
+            return 0;
+
+        case init_evasions_stage:
+            // In check there are few legal moves, so generate them all and order them together
+            board->GenerateMoves(&move_list, evasions);
+            ScoreMoves(false);
+            index = 0;
+            stage = evasions_stage;
+            [[fallthrough]];
+
+        case evasions_stage:
+            while (index < move_list.count)
+            {
+                int move = PickBest();
+                if (move != hash_move)
+                    return move;
+            }
+            stage = done_stage;
+            return 0;
+
+        default:
+            return 0;
+    }
+}
+
+/* Scores every move of the current stage once, as it is generated */
+void MovePicker::ScoreMoves(bool quiets)
+{
+    for (int count = 0; count < move_list.count; count++)
+    {
+        int move = move_list.moves[count];
+        scores[count] = quiets ? board->QuietHistory(move) : board->ScoreMove(move);
+    }
+}
+
+/* One step of a selection sort: finds the best scored move from index on, swaps it (and its score) to index and
+hands it out. Ties go to the move generated first */
+int MovePicker::PickBest()
+{
+    int best = index;
+    for (int count = index + 1; count < move_list.count; count++)
+        if (scores[count] > scores[best])
+            best = count;
+
+    std::swap(move_list.moves[index], move_list.moves[best]);
+    std::swap(scores[index], scores[best]);
+
+    return move_list.moves[index++];
+}
+
+/* Returns true if the capture or promotion loses material by static exchange evaluation. Taking a piece worth at
+least as much as the capturing one can't lose material, so those skip the exchange evaluation */
+bool MovePicker::IsLosingCapture(int move)
+{
+    int attacker = board->piece_on[get_move_source(move)] % 6;
+    int victim = board->piece_on[get_move_target(move)] % 6;
+    if (get_move_capture(move) && !get_move_promoted(move) && (get_move_enpassant(move) || victim >= attacker))
+        return false;
+
+    return board->StaticExchange(move) < 0;
+}
+
+/* Returns true if a killer move or countermove belongs in its stage: it exists, isn't the hash move (already tried)
+and isn't a capture or promotion (those come with the captures) */
+bool MovePicker::IsQuietRefutation(int move)
+{
+    return move && move != hash_move && !get_move_capture(move) && !get_move_promoted(move);
+}
+
+/* Returns true if the move was already handed out by the hash move, killer or countermove stages */
+bool MovePicker::AlreadyTried(int move)
+{
+    return move == hash_move || move == killers[0] || move == killers[1] || move == counter_move;
+}
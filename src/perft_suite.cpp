@@ -0,0 +1,110 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <memory>
+
+#include "perft_suite.h"
+#include "utils.h"
+#include "board.h"
+
+using namespace std;
+
+
+/* Reads the suite line by line, runs perft on every listed depth of every position and reports the mismatches and the
+node rate per position and over the whole suite */
+bool RunPerftSuite(string path, int max_depth, int threads, int hash_mb)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cout << "could not open perft suite " << path << endl;
+        return false;
+    }
+
+    // totals over the whole suite
+    int positions = 0;
+    int failed_positions = 0;
+    U64 total_nodes = 0;
+    double total_seconds = 0;
+
+    // one board for every position, SetFEN resets it
+    Board board;
+
+    // One hash table for the whole suite, if asked for. Its counts are exact for a position and depth, so what one
+    // depth stored speeds up the deeper ones, and a transposition shared between positions is counted once
+    unique_ptr<PerftTable> table = (hash_mb > 0) ? make_unique<PerftTable>(hash_mb) : nullptr;
+
+    string line;
+    while (getline(file, line))
+    {
+        // the FEN is everything before the first ';', skip blank lines and comments
+        size_t split = line.find(';');
+        string fen = line.substr(0, split);
+        if (fen.find_first_not_of(" \t\r") == string::npos || fen[fen.find_first_not_of(" \t")] == '#')
+            continue;
+
+        board.SetFEN(fen);
+        positions++;
+
+        // counts and time for this position
+        bool passed = true;
+        U64 position_nodes = 0;
+        double position_seconds = 0;
+
+        cout << "position " << positions << ": " << fen << endl;
+
+        // every ";D<depth> <count>" field after the FEN
+        while (split != string::npos)
+        {
+            size_t next = line.find(';', split + 1);
+            stringstream field(line.substr(split + 1, next - split - 1));
+            split = next;
+
+            // read the depth and the expected count
+            char tag;
+            int depth;
+            U64 expected;
+            if (!(field >> tag >> depth >> expected) || (tag != 'D' && tag != 'd'))
+                continue;
+
+            if (max_depth > 0 && depth > max_depth)
+                continue;
+
+            // count the tree on the wall clock, since the threads run alongside each other
+            auto start = chrono::steady_clock::now();
+            U64 nodes = board.PerftNodes(depth, threads, table.get());
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+            position_nodes += nodes;
+            position_seconds += seconds;
+
+            if (nodes != expected)
+            {
+                passed = false;
+                cout << "    D" << depth << " MISMATCH: expected " << expected << ", got " << nodes << endl;
+            }
+            else
+                cout << "    D" << depth << " ok: " << nodes << endl;
+        }
+
+        if (!passed)
+            failed_positions++;
+
+        total_nodes += position_nodes;
+        total_seconds += position_seconds;
+
+        cout << "    " << (passed ? "passed" : "FAILED") << ", " << position_nodes << " nodes in " << position_seconds <<
+            " seconds (" << (position_seconds > 0 ? position_nodes / position_seconds / 1000000 : 0.0) <<
+            " million nodes per second)" << endl;
+    }
+
+    cout << endl << positions - failed_positions << " of " << positions << " positions passed" << endl;
+    cout << "nodes searched: " << total_nodes << endl;
+    cout << "total time: " << total_seconds << " seconds" << endl;
+    cout << (total_seconds > 0 ? total_nodes / total_seconds / 1000000 : 0.0) << " million nodes per second" << endl;
+
+    return failed_positions == 0;
+}
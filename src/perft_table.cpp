@@ -0,0 +1,50 @@
+#include "perft_table.h"
+
+
+/* Sizes the table to the largest power of two number of buckets that fits in the given number of megabytes */
+PerftTable::PerftTable(int megabytes)
+{
+    U64 bucket_count = 1;
+    while (bucket_count * 2 * sizeof(Bucket) <= (U64)megabytes * 1024 * 1024)
+        bucket_count *= 2;
+
+    buckets = std::vector<Bucket>(bucket_count);
+    mask = bucket_count - 1;
+}
+
+/* Checks both entries of the key's bucket. An entry matches if its key XORs back out of the check word and it was
+stored at the same depth. Nothing is ever stored at depth 0, so an empty (all zero) entry never matches */
+bool PerftTable::Probe(U64 key, int depth, U64 &nodes)
+{
+    Bucket &bucket = buckets[key & mask];
+
+    for (Entry *entry : {&bucket.deepest, &bucket.newest})
+    {
+        U64 data = entry->data.load(std::memory_order_relaxed);
+        U64 check = entry->check.load(std::memory_order_relaxed);
+
+        if ((check ^ data) == key && (int)(data & 0xff) == depth)
+        {
+            nodes = data >> 8;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/* Stores the count in the depth-preferred entry if it is at least as deep as what is there, otherwise in the
+always-replace entry */
+void PerftTable::Store(U64 key, int depth, U64 nodes)
+{
+    Bucket &bucket = buckets[key & mask];
+
+    U64 data = (nodes << 8) | (U64)depth;
+
+    // depth of the result kept in the depth-preferred entry
+    int deepest_depth = (int)(bucket.deepest.data.load(std::memory_order_relaxed) & 0xff);
+
+    Entry &entry = (depth >= deepest_depth) ? bucket.deepest : bucket.newest;
+    entry.check.store(key ^ data, std::memory_order_relaxed);
+    entry.data.store(data, std::memory_order_relaxed);
+}
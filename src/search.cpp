@@ -0,0 +1,264 @@
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <functional>
+#include <algorithm>
+
+#include "search.h"
+#include "transposition_table.h"
+
+using namespace std;
+
+
+/* One thread until told otherwise */
+Search::Search()
+{
+    SetThreads(1);
+}
+
+/* A search can't be left running on its own */
+Search::~Search()
+{
+    Stop();
+}
+
+/* Starts a pool with one worker per search thread, and allocates each thread's continuation history */
+void Search::SetThreads(int count)
+{
+    Stop();
+    pool = make_unique<ThreadPool>(max(1, count));
+    continuation_histories.assign(pool->Size(), vector<Board::PieceToHistory>(12 * 64));
+}
+
+/* Copies the board for every thread here, before returning, so the caller is free to change its board as soon as
+this returns, then starts the search thread */
+void Search::Start(Board &board, SearchLimits search_limits)
+{
+    Stop();
+
+    int threads = pool->Size();
+
+    limits = search_limits;
+    limits.depth = max(1, min(limits.depth, max_ply - 1));
+    infinite = limits.infinite;
+    stop = false;
+
+    // every thread searches its own copy, watching the shared stop flag
+    boards = vector<Board>(threads, board);
+    for (int index = 0; index < threads; index++)
+    {
+        // each thread learns its continuation history afresh, in the table it keeps between searches
+        fill(continuation_histories[index].begin(), continuation_histories[index].end(), Board::PieceToHistory{});
+        boards[index].continuation_history = continuation_histories[index].data();
+
+        boards[index].stop_flag = &stop;
+        boards[index].NewSearch();
+    }
+
+    thread_nodes = vector<atomic<U64>>(threads);
+    results = vector<Result>(threads);
+
+    // entries from earlier searches are kept, but are replaced first
+    transposition_table.NewSearch();
+
+    // the clock starts now (or at ponderhit)
+    time_manager.Start((Color)board.turn_to_move, limits.time, limits.increment, limits.moves_to_go, limits.move_time, limits.ponder);
+
+    search_thread = thread(&Search::Run, this);
+}
+
+/* Ends an infinite or ponder search's wait as well as the search itself. The threads notice the flag within a node,
+so the bestmove (from the last finished iteration) comes straight back */
+void Search::Stop()
+{
+    {
+        lock_guard<mutex> guard(wait_lock);
+        infinite = false;
+        stop = true;
+    }
+    wake.notify_all();
+
+    Wait();
+}
+
+/* Switches a ponder search to a normal search timed from now. Does nothing if the search isn't pondering, so a stray
+ponderhit doesn't restart the clock of a normal search */
+void Search::PonderHit()
+{
+    {
+        lock_guard<mutex> guard(wait_lock);
+        time_manager.PonderHit();
+    }
+    wake.notify_all();
+}
+
+/* Joins the search thread */
+void Search::Wait()
+{
+    if (search_thread.joinable())
+        search_thread.join();
+}
+
+/* Runs the threads until the main thread finishes, then reports the best result */
+void Search::Run()
+{
+    int threads = pool->Size();
+
+    // one iterative deepening loop per thread
+    vector<function<void(int)>> tasks;
+    for (int index = 0; index < threads; index++)
+        tasks.push_back([this, index](int) { IterativeDeepening(index); });
+
+    pool->Run(tasks);
+
+    // the deepest result wins, ties go to the thread with the lowest index (the main thread first)
+    int best = 0;
+    for (int index = 1; index < threads; index++)
+        if (results[index].depth > results[best].depth)
+            best = index;
+
+    // a helper that got further than the main thread reports its line too
+    if (best != 0)
+        PrintInfo(results[best]);
+
+    // stopped before the first iteration finished, play any legal move rather than none
+    vector<Move> &pv = results[best].pv;
+    if (pv.empty())
+    {
+        MoveList moves;
+        boards[0].GenerateMoves(&moves);
+        if (moves.count)
+            pv.push_back(moves.moves[0]);
+    }
+
+    // report the move, and the reply expected to it for the GUI to ponder on. Written in one go, the UCI loop may
+    // be printing at the same time
+    string line = "bestmove " + (pv.empty() ? string("0000") : MoveString(pv[0]));
+    if (pv.size() > 1)
+        line += " ponder " + MoveString(pv[1]);
+
+    cout << line + "\n" << flush;
+}
+
+/* Searches one ply deeper each iteration until the depth is reached or the search is stopped. Only the main thread
+prints and decides when to stop, helpers keep going until it does or they reach the depth themselves */
+void Search::IterativeDeepening(int index)
+{
+    Board &board = boards[index];
+
+    // score of the last finished iteration, for the side to move
+    int score = 0;
+
+    // odd helpers search one ply deeper than the main thread would at each iteration
+    int depth_offset = index & 1;
+
+    for (int current_depth = 1; current_depth + depth_offset <= limits.depth; current_depth++)
+    {
+        // From the fourth iteration on the score is expected near the last one, so the search starts with a narrow
+        // window around it and only widens it (twice as far each time) if the score falls outside. A narrow window
+        // cuts off far more. Mate scores move too far between iterations to guess
+        int delta = 25;
+        int alpha = -infinity;
+        int beta = infinity;
+        if (current_depth >= 4 && abs(score) < mate_score)
+        {
+            alpha = max(-infinity, score - delta);
+            beta = min(infinity, score + delta);
+        }
+
+        while (true)
+        {
+            score = board.SearchRoot(current_depth + depth_offset, alpha, beta);
+
+            if (stop)
+                break;
+
+            // failed low or high, search again with the window widened on that side
+            delta *= 2;
+            if (score <= alpha && alpha > -infinity)
+                alpha = (delta > 400) ? -infinity : max(-infinity, score - delta);
+            else if (score >= beta && beta < infinity)
+                beta = (delta > 400) ? infinity : min(infinity, score + delta);
+            else
+                break;
+        }
+
+        // an interrupted iteration is thrown away
+        if (stop)
+            break;
+
+        thread_nodes[index] = board.nodes;
+
+        // keep this iteration's result
+        Result result;
+        result.depth = current_depth + depth_offset;
+        result.score = (board.turn_to_move == white) ? score : -score;
+        result.pv.assign(board.pv_table[0], board.pv_table[0] + board.pv_length[0]);
+        {
+            lock_guard<mutex> guard(results_lock);
+            results[index] = result;
+        }
+
+        // The main thread reports each iteration and decides whether there is time for another. Once it has a
+        // move to play, its board aborts the search on the hard time limit
+        if (index == 0)
+        {
+            PrintInfo(result);
+
+            board.time_manager = &time_manager;
+
+            if (time_manager.SoftLimitReached(result.pv.empty() ? 0 : result.pv[0], score))
+                break;
+        }
+    }
+
+    if (index != 0)
+        return;
+
+    // An infinite or ponder search that ran out of depth holds its move back until stop or ponderhit. A ponderhit
+    // after the time is up ends the search at once
+    {
+        unique_lock<mutex> guard(wait_lock);
+        wake.wait(guard, [this] {
+            return stop || (!infinite && !time_manager.Pondering());
+        });
+    }
+
+    // the main thread is done, so is everyone else
+    stop = true;
+}
+
+/* Adds up the nodes the threads have published */
+U64 Search::TotalNodes()
+{
+    U64 total = 0;
+    for (atomic<U64> &nodes : thread_nodes)
+        total += nodes;
+
+    return total;
+}
+
+/* Adds up the cutoff counts of every thread's board */
+void Search::CutoffCounts(U64 &cutoffs, U64 &first_move_cutoffs)
+{
+    cutoffs = 0;
+    first_move_cutoffs = 0;
+    for (Board &board : boards)
+    {
+        cutoffs += board.beta_cutoffs;
+        first_move_cutoffs += board.first_move_cutoffs;
+    }
+}
+
+/* Prints the depth, score, nodes of all threads and PV of a result, as one write */
+void Search::PrintInfo(Result &result)
+{
+    stringstream line;
+    line << "info score cp " << result.score << " depth " << result.depth << " nodes " << TotalNodes() << " pv ";
+
+    // add every PV move
+    for (Move move : result.pv)
+        line << MoveString(move) << " ";
+
+    cout << line.str() + "\n" << flush;
+}
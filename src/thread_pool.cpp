@@ -0,0 +1,121 @@
+#include "thread_pool.h"
+
+
+/* Starts the workers, which wait for the first batch */
+ThreadPool::ThreadPool(int thread_count) : queues(thread_count)
+{
+    for (int index = 0; index < thread_count; index++)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this, index);
+}
+
+/* Wakes the workers up with the stopping flag set and waits for them to exit */
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> guard(state_lock);
+        stopping = true;
+    }
+    batch_started.notify_all();
+
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+/* Deals the tasks out round-robin over the workers' queues, starts the workers on them and waits until every task
+has finished */
+void ThreadPool::Run(std::vector<std::function<void(int)>> &tasks)
+{
+    // nothing to do
+    if (tasks.empty())
+        return;
+
+    // set the batch up before any of its tasks can be taken
+    std::unique_lock<std::mutex> guard(state_lock);
+    batch = &tasks;
+    pending = (int)tasks.size();
+    batch_number++;
+
+    // Deal the tasks out. A worker may still be looking through the queues after the last batch, so they are
+    // locked, and a task it takes from this batch is simply run early
+    for (int task = 0; task < (int)tasks.size(); task++)
+    {
+        TaskQueue &queue = queues[task % queues.size()];
+        std::lock_guard<std::mutex> queue_guard(queue.lock);
+        queue.tasks.push_back(task);
+    }
+
+    // start the batch
+    batch_started.notify_all();
+
+    // wait for the last task to finish
+    batch_finished.wait(guard, [this] { return pending == 0; });
+    batch = nullptr;
+}
+
+/* Waits for a batch, runs tasks until there are none left to take or steal, then waits for the next batch */
+void ThreadPool::WorkerLoop(int index)
+{
+    // the last batch this worker has run
+    int seen_batch = 0;
+
+    while (true)
+    {
+        // wait for a new batch (or for the pool to stop)
+        {
+            std::unique_lock<std::mutex> guard(state_lock);
+            batch_started.wait(guard, [&] { return stopping || batch_number != seen_batch; });
+
+            if (stopping)
+                return;
+
+            seen_batch = batch_number;
+        }
+
+        // run tasks until every queue is empty
+        int task;
+        while (TakeTask(index, task))
+        {
+            (*batch)[task](index);
+
+            // the worker finishing the last task wakes up Run
+            if (--pending == 0)
+            {
+                std::lock_guard<std::mutex> guard(state_lock);
+                batch_finished.notify_all();
+            }
+        }
+    }
+}
+
+/* Pops a task from the back of the worker's own queue, or failing that steals one from the front of the next
+non-empty queue. Tasks are never added while a batch runs, so once every queue has been found empty there is no
+more work for this worker */
+bool ThreadPool::TakeTask(int index, int &task)
+{
+    // own queue first
+    {
+        std::lock_guard<std::mutex> guard(queues[index].lock);
+        if (!queues[index].tasks.empty())
+        {
+            task = queues[index].tasks.back();
+            queues[index].tasks.pop_back();
+            return true;
+        }
+    }
+
+    // then steal, starting with the next worker along
+    for (int offset = 1; offset < (int)queues.size(); offset++)
+    {
+        TaskQueue &victim = queues[(index + offset) % queues.size()];
+
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty())
+        {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <algorithm>
+
+#include "time_manager.h"
+
+using namespace std;
+
+
+// Default Move Overhead
+int TimeManager::move_overhead = 30;
+
+
+/* Splits the time left evenly over the moves still to play (30 if the time control doesn't say), plus most of the
+increment, as the soft limit. The hard limit allows four times that, and neither may eat into the move overhead */
+void TimeManager::Start(Color side, int time[2], int increment[2], int moves_to_go, int move_time, bool ponder)
+{
+    start_time = Now();
+    pondering = ponder;
+
+    last_move = 0;
+    last_score = 0;
+    stable_iterations = 0;
+    scaled = false;
+
+    // a fixed time per move, less the overhead so the bestmove arrives within it (at least a millisecond)
+    if (move_time)
+    {
+        soft_limit = hard_limit = max(1, move_time - move_overhead);
+        return;
+    }
+
+    // no clock, no limit
+    if (!time[side])
+    {
+        soft_limit = hard_limit = 0;
+        return;
+    }
+
+    // what can be spent without risking the clock, at least a millisecond
+    long long usable = max(1LL, (long long)time[side] - move_overhead);
+
+    // moves left to spread the time over
+    int moves_left = moves_to_go ? moves_to_go : 30;
+
+    soft_limit = min(usable, (long long)time[side] / moves_left + increment[side] * 3 / 4);
+    soft_limit = max(1LL, soft_limit);
+    hard_limit = min(usable, soft_limit * 4);
+    scaled = true;
+}
+
+/* The clock starts now, if it wasn't running already: a ponderhit during a normal search changes nothing */
+void TimeManager::PonderHit()
+{
+    if (!pondering)
+        return;
+
+    start_time = Now();
+    pondering = false;
+}
+
+/* Milliseconds since start_time */
+long long TimeManager::Elapsed()
+{
+    return Now() - start_time;
+}
+
+/* The hard limit is reached once that much time has passed, with the clock running */
+bool TimeManager::HardLimitReached()
+{
+    return hard_limit && !pondering && Elapsed() >= hard_limit;
+}
+
+/* Scales the soft limit and compares it to the time used. A best move that hasn't changed for a while needs less
+time (down to 0.8 of the soft limit after six iterations), a new one more (1.4). A score that fell since the last
+iteration stretches it by up to another half, for a drop of 150 centipawns or more. It is never stretched past the
+hard limit. No iteration is started that couldn't finish within it */
+bool TimeManager::SoftLimitReached(int best_move, int score)
+{
+    // how often the best move has stayed the same, and by how much the score fell
+    stable_iterations = (best_move == last_move) ? stable_iterations + 1 : 0;
+    int score_drop = (last_move && last_score > score) ? min(last_score - score, 150) : 0;
+
+    last_move = best_move;
+    last_score = score;
+
+    if (!soft_limit || pondering)
+        return false;
+
+    // with a fixed time per move, keep deepening until it is used up
+    if (!scaled)
+        return Elapsed() >= soft_limit;
+
+    double stability = 1.4 - 0.1 * min(stable_iterations, 6);
+    double drop = 1.0 + 0.5 * score_drop / 150;
+    double limit = min((double)hard_limit, soft_limit * stability * drop);
+
+    // the next iteration takes at least as long as all of the ones before it, so once half of the limit is gone it
+    // would only end up aborted
+    return Elapsed() >= limit / 2;
+}
+
+/* Milliseconds on the steady clock */
+long long TimeManager::Now()
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,124 @@
+#include "transposition_table.h"
+
+
+// The table shared by every search, resized by the Hash option
+TranspositionTable transposition_table(16);
+
+
+/* Allocates the table */
+TranspositionTable::TranspositionTable(int megabytes)
+{
+    Resize(megabytes);
+}
+
+/* Sizes the table to the largest power of two number of buckets that fits in the given number of megabytes */
+void TranspositionTable::Resize(int megabytes)
+{
+    U64 bucket_count = 1;
+    while (bucket_count * 2 * sizeof(Bucket) <= (U64)megabytes * 1024 * 1024)
+        bucket_count *= 2;
+
+    // free the old table before allocating the new one, so both never have to fit in memory at once
+    buckets = std::vector<Bucket>();
+    buckets = std::vector<Bucket>(bucket_count);
+    mask = bucket_count - 1;
+    generation = 0;
+}
+
+/* Zeroes every entry, an all zero entry never matches a key (its depth is 0 but its check isn't the key) */
+void TranspositionTable::Clear()
+{
+    for (Bucket &bucket : buckets)
+    {
+        for (Entry &entry : bucket.entries)
+        {
+            entry.check.store(0, std::memory_order_relaxed);
+            entry.data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    generation = 0;
+}
+
+/* Moves on to the next generation */
+void TranspositionTable::NewSearch()
+{
+    generation = (generation + 1) & 63;
+}
+
+/* Looks for the key in its bucket and unpacks the entry if it is there */
+bool TranspositionTable::Probe(U64 key, HashEntry &entry)
+{
+    Bucket &bucket = buckets[key & mask];
+
+    for (Entry &slot : bucket.entries)
+    {
+        U64 data = slot.data.load(std::memory_order_relaxed);
+        U64 check = slot.check.load(std::memory_order_relaxed);
+
+        if ((check ^ data) != key || !data)
+            continue;
+
+        entry.move = (Move)(data & 0xffff);
+        entry.score = (int)((data >> 16) & 0x3ffff) - score_offset;
+        entry.depth = (int)((data >> 34) & 0xff);
+        entry.flag = (int)((data >> 42) & 0x3);
+        return true;
+    }
+
+    return false;
+}
+
+/* Writes the result over the entry of the same position if the bucket has one, otherwise over the entry least worth
+keeping: every search the entry is old counts as much as 8 plies of depth. A result without a move keeps the move
+already stored for the position. A shallower result doesn't replace a deeper one of the same position from this
+search (quiescence stores depth 0 under the same keys as NegaMax), unless it is exact */
+void TranspositionTable::Store(U64 key, int depth, int flag, int score, int move)
+{
+    Bucket &bucket = buckets[key & mask];
+
+    // the entry to overwrite and how much it is worth keeping
+    Entry *replace = nullptr;
+    int replace_value = 0;
+
+    for (Entry &slot : bucket.entries)
+    {
+        U64 data = slot.data.load(std::memory_order_relaxed);
+        U64 check = slot.check.load(std::memory_order_relaxed);
+
+        // the same position, keep its move if there is no new one
+        if ((check ^ data) == key)
+        {
+            // a deeper result of this search is worth more than a shallower bound
+            int stored_depth = (int)((data >> 34) & 0xff);
+            int stored_generation = (int)((data >> 44) & 0x3f);
+            if (depth < stored_depth && flag != hash_exact && stored_generation == generation)
+                return;
+
+            if (!move)
+                move = (int)(data & 0xffff);
+
+            replace = &slot;
+            break;
+        }
+
+        // depth, less 8 for every search since the entry was stored
+        int age = (generation - (int)((data >> 44) & 0x3f)) & 63;
+        int value = (int)((data >> 34) & 0xff) - 8 * age;
+
+        if (!replace || value < replace_value)
+        {
+            replace = &slot;
+            replace_value = value;
+        }
+    }
+
+    U64 data = (U64)(move & 0xffff)
+             | ((U64)(score + score_offset) << 16)
+             | ((U64)depth << 34)
+             | ((U64)flag << 42)
+             | ((U64)generation << 44);
+
+    replace->check.store(key ^ data, std::memory_order_relaxed);
+    replace->data.store(data, std::memory_order_relaxed);
+}
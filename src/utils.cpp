@@ -8,18 +8,8 @@
 using namespace std;
 
 
-/* Helper function used to find either the least significant bit (rightmost) or the most significant bit
-(leftmost) of a bitboard. bitscan reverse is used to find the MSB */
-int BitScan(U64 bitboard){
-
-    // return the bitscan to get least significant bit using a built in function
-    return __builtin_ffsll(bitboard) - 1;
-}
-
-
-
-/* Prints out the move in UCI format as  bestmove source - target - promoted piece */
-string PrintMove(int move){
+/* Returns the move in UCI format as source - target - promoted piece */
+string MoveString(int move){
 
     // extract the start, end, and if applicable, promotion piece of the move
     int source = get_move_source(move);
@@ -27,7 +17,13 @@ string PrintMove(int move){
     int promoted = get_move_promoted(move);
 
     // construct the move string as start-end-promoted, or (e7e8q)/ (b1b7)
-    string move_str = square_index[source] + square_index[target] + ((promoted) ? promoted_pieces[promoted] : "");
+    return square_index[source] + square_index[target] + ((promoted) ? promoted_pieces[promoted] : "");
+}
+
+/* Prints out the move in UCI format as  bestmove source - target - promoted piece */
+string PrintMove(int move){
+
+    string move_str = MoveString(move);
     cout <<  move_str;
     return move_str;
 }
@@ -0,0 +1,35 @@
+#include "utils.h"
+#include "zobrist.h"
+
+
+/* xorshift64* pseudo random number generator. Advances the state and returns the next number. The keys only need to
+look random and be the same on every run, so a fixed seed is used */
+static constexpr U64 RandomU64(U64 &state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1DULL;
+}
+
+/* Draws every key from the generator in a fixed order */
+constexpr ZobristKeys::ZobristKeys()
+{
+    // generator state, any non-zero seed will do
+    U64 state = 1070372ULL;
+
+    for (int piece = P; piece <= k; piece++)
+        for (int square = 0; square < 64; square++)
+            piece_keys[piece][square] = RandomU64(state);
+
+    for (int square = 0; square < 64; square++)
+        enpassant_keys[square] = RandomU64(state);
+
+    for (int rights = 0; rights < 16; rights++)
+        castle_keys[rights] = RandomU64(state);
+
+    side_key = RandomU64(state);
+}
+
+// The single set of keys used by the whole program, computed at compile time
+constexpr ZobristKeys zobrist_keys;